@@ -0,0 +1,73 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include "utilities.h"
+#include "arena.h"
+
+// The arena is a list of blocks, the newest first;
+// allocations are made from the unused end of the newest block
+// (larger requests get a block of their own)
+typedef struct arena_block_s {
+    struct arena_block_s *next;
+    size_t size;    // the number of bytes in data
+    size_t used;    // the number of those bytes allocated
+    alignas(max_align_t) char data[];
+} arena_block;
+
+static arena_block *blocks = NULL;
+
+// Return size rounded up to a multiple of the strictest alignment
+static size_t aligned_size(size_t size)
+{
+    const size_t align = alignof(max_align_t);
+    return (size + align - 1) & ~(align - 1);
+}
+
+// Add a new block with room for at least size bytes to the arena
+static void add_block(size_t size)
+{
+    size_t data_size = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+    arena_block *b = (arena_block *)malloc(sizeof(arena_block) + data_size);
+    if (b == NULL) {
+	bail_with_error("Not enough space to allocate an arena block!");
+    }
+    b->size = data_size;
+    b->used = 0;
+    b->next = blocks;
+    blocks = b;
+}
+
+// Return a pointer to size bytes of fresh (uninitialized) space,
+// suitably aligned for any type.
+// If there is not enough space, bail with an error,
+// so this will never return NULL.
+void *arena_alloc(size_t size)
+{
+    size = aligned_size(size);
+    if (blocks == NULL || blocks->size - blocks->used < size) {
+	add_block(size);
+    }
+    void *ret = blocks->data + blocks->used;
+    blocks->used += size;
+    return ret;
+}
+
+// Return a copy of the string s allocated in the arena
+char *arena_strdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *ret = (char *)arena_alloc(len);
+    memcpy(ret, s, len);
+    return ret;
+}
+
+// Free all the space allocated by arena_alloc and arena_strdup,
+// so none of the pointers it returned can be used again
+void arena_free_all()
+{
+    while (blocks != NULL) {
+	arena_block *next = blocks->next;
+	free(blocks);
+	blocks = next;
+    }
+}
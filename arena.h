@@ -0,0 +1,27 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+#include <stddef.h>
+
+// Region (arena) allocation for the compiler's data structures
+// (code, ASTs, id_uses, id_attrs, file locations, and token text).
+// These are never freed individually; they are allocated by bumping
+// a pointer in a large block, and all of them are freed at once
+// (by arena_free_all) when a compilation is done.
+
+// the size of each block that small allocations are carved out of
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// Return a pointer to size bytes of fresh (uninitialized) space,
+// suitably aligned for any type.
+// If there is not enough space, bail with an error,
+// so this will never return NULL.
+extern void *arena_alloc(size_t size);
+
+// Return a copy of the string s allocated in the arena
+extern char *arena_strdup(const char *s);
+
+// Free all the space allocated by arena_alloc and arena_strdup,
+// so none of the pointers it returned can be used again
+extern void arena_free_all();
+
+#endif
@@ -5,6 +5,7 @@
 #include "utilities.h"
 #include "ast.h"
 #include "spl.tab.h"
+#include "arena.h"
 
 // Return the file location from an AST
 file_location *ast_file_loc(AST t) {
@@ -29,10 +30,7 @@ AST_type ast_type_tag(AST t) {
 // Return a pointer to a fresh copy of t
 // that has been allocated on the heap
 AST *ast_heap_copy(AST t) {
-    AST *ret = (AST *)malloc(sizeof(AST));
-    if (ret == NULL) {
-	bail_with_error("Cannot allocate an AST heap copy!");
-    }
+    AST *ret = (AST *)arena_alloc(sizeof(AST));
     *ret = t;
     return ret;
 }
@@ -68,10 +66,7 @@ const_decls_t ast_const_decls(const_decls_t const_decls,
 {
     const_decls_t ret = const_decls;
     // make a copy of const_decl on the heap
-    const_decl_t *p = (const_decl_t *) malloc(sizeof(const_decl_t));
-    if (p == NULL) {
-	bail_with_error("Cannot allocate space for %s!", "const_decl_t");
-    }
+    const_decl_t *p = (const_decl_t *) arena_alloc(sizeof(const_decl_t));
     *p = const_decl;
     p->next = NULL;
     const_decl_t *last = ast_last_list_elem(ret.start);
@@ -102,10 +97,7 @@ extern const_def_list_t ast_const_def_list_singleton(const_def_t const_def)
     const_def_list_t ret;
     ret.file_loc = const_def.file_loc;
     ret.type_tag = const_def_list_ast;
-    const_def_t *p = (const_def_t *) malloc(sizeof(const_def_t));
-    if (p == NULL) {							
-	bail_with_error("Unable to allocate space for a %s!", "const_def_t"); 
-    }		    
+    const_def_t *p = (const_def_t *) arena_alloc(sizeof(const_def_t));
     *p = const_def;		
     p->next = NULL;    
     ret.start = p;							
@@ -118,10 +110,7 @@ extern const_def_list_t ast_const_def_list(const_def_list_t const_def_list,
 {
     const_def_list_t ret = const_def_list;
     // make a copy of const_def on the heap
-    const_def_t *p = (const_def_t *) malloc(sizeof(const_def_t));
-    if (p == NULL) {
-	bail_with_error("Cannot allocate space for %s!", "const_def_t");
-    }
+    const_def_t *p = (const_def_t *) arena_alloc(sizeof(const_def_t));
     *p = const_def;
     p->next = NULL;
     const_def_t *last = ast_last_list_elem(ret.start);
@@ -162,10 +151,7 @@ var_decls_t ast_var_decls(var_decls_t var_decls, var_decl_t var_decl)
 {
     var_decls_t ret = var_decls;
     // make a copy of var_decl on the heap
-    var_decl_t *p = (var_decl_t *) malloc(sizeof(var_decl_t));
-    if (p == NULL) {
-	bail_with_error("Cannot allocate space for %s!", "var_decl_t");
-    }
+    var_decl_t *p = (var_decl_t *) arena_alloc(sizeof(var_decl_t));
     *p = var_decl;
     p->next = NULL;
     var_decl_t *last = ast_last_list_elem(ret.var_decls);
@@ -195,10 +181,7 @@ extern ident_list_t ast_ident_list_singleton(ident_t ident)
     ret.file_loc = ident.file_loc;
     ret.type_tag = ident_list_ast;
     // make a copy of ident on the heap
-    ident_t *p = (ident_t *) malloc(sizeof(ident_t));	
-    if (p == NULL) {							
-	bail_with_error("Unable to allocate space for a %s!", "ident_t"); 
-    }		    
+    ident_t *p = (ident_t *) arena_alloc(sizeof(ident_t));	
     *p = ident;		
     p->next = NULL;    
     ret.start = p;						
@@ -210,10 +193,7 @@ extern ident_list_t ast_ident_list(ident_list_t ident_list, ident_t ident)
 {
     ident_list_t ret = ident_list;
     // make a copy of ident on the heap
-    ident_t *p = (ident_t *) malloc(sizeof(ident_t));
-    if (p == NULL) {
-	bail_with_error("Cannot allocate space for %s!", "ident_t");
-    }
+    ident_t *p = (ident_t *) arena_alloc(sizeof(ident_t));
     *p = ident;
     p->next = NULL;
     ident_t *last = ast_last_list_elem(ret.start);
@@ -241,10 +221,7 @@ proc_decls_t ast_proc_decls(proc_decls_t proc_decls,
 {
     proc_decls_t ret = proc_decls;
     // make a copy of proc_decl on the heap
-    proc_decl_t *p = (proc_decl_t *) malloc(sizeof(proc_decl_t));	
-    if (p == NULL) {							
-	bail_with_error("Unable to allocate space for a %s!", "proc_decl_t"); 
-    }		    
+    proc_decl_t *p = (proc_decl_t *) arena_alloc(sizeof(proc_decl_t));	
     *p = proc_decl;		
     p->next = NULL;    
     proc_decl_t *last = ast_last_list_elem(ret.proc_decls);
@@ -264,10 +241,7 @@ proc_decl_t ast_proc_decl(ident_t ident, block_t block)
     ret.type_tag = proc_decl_ast;
     ret.next = NULL;
     ret.name = ident.name;
-    block_t *p = (block_t *) malloc(sizeof(block_t));
-    if (p == NULL) {
-	bail_with_error("Unable to allocate space for a %s!", "block_t");
-    }
+    block_t *p = (block_t *) arena_alloc(sizeof(block_t));
     *p = block;
     ret.block = p;
     return ret;
@@ -297,10 +271,7 @@ while_stmt_t ast_while_stmt(condition_t condition, stmts_t body) {
     ret.file_loc = condition.file_loc;
     ret.type_tag = while_stmt_ast;
     ret.condition = condition;
-    stmts_t *p = (stmts_t *) malloc(sizeof(stmts_t));
-    if (p == NULL) {
-	bail_with_error("Unable to allocate space for a %s!", "stmts_t"); 
-    }
+    stmts_t *p = (stmts_t *) arena_alloc(sizeof(stmts_t));
     *p = body;		
     ret.body = p;					
     return ret;
@@ -315,17 +286,11 @@ if_stmt_t ast_if_then_else_stmt(condition_t condition,
     ret.type_tag = if_stmt_ast;
     ret.condition = condition;
     // copy then_stmt to the heap
-    stmts_t *p = (stmts_t *) malloc(sizeof(stmts_t));			
-    if (p == NULL) {							
-	bail_with_error("Unable to allocate space for a %s!", "stmts_t"); 
-    }									
+    stmts_t *p = (stmts_t *) arena_alloc(sizeof(stmts_t));			
     *p = then_stmts;	
     ret.then_stmts = p;						
     // copy else_stmts to the heap
-    p = (stmts_t *) malloc(sizeof(stmts_t));	
-    if (p == NULL) {							
-	bail_with_error("Unable to allocate space for a %s!", "stmts_t"); 
-    }		    
+    p = (stmts_t *) arena_alloc(sizeof(stmts_t));	
     *p = else_stmts;		
     ret.else_stmts = p;						
     return ret;
@@ -341,10 +306,7 @@ extern if_stmt_t ast_if_then_stmt(condition_t condition,
     ret.type_tag = if_stmt_ast;
     ret.condition = condition;
     // copy then_stmt to the heap
-    stmts_t *p = (stmts_t *) malloc(sizeof(stmts_t));			
-    if (p == NULL) {							
-	bail_with_error("Unable to allocate space for a %s!", "stmts_t"); 
-    }									
+    stmts_t *p = (stmts_t *) arena_alloc(sizeof(stmts_t));			
     *p = then_stmts;	
     ret.then_stmts = p;						
     ret.else_stmts = NULL;						
@@ -359,10 +321,7 @@ block_stmt_t ast_block_stmt(block_t block)
     ret.file_loc = block.file_loc;
     ret.type_tag = block_stmt_ast;
     // copy the block to the heap
-    block_t *p = (block_t *) malloc(sizeof(block_t));			
-    if (p == NULL) {							
-	bail_with_error("Unable to allocate space for a %s!", "block_t"); 
-    }									
+    block_t *p = (block_t *) arena_alloc(sizeof(block_t));			
     *p = block;	
     ret.block = p;
     return ret;
@@ -386,10 +345,7 @@ assign_stmt_t ast_assign_stmt(ident_t ident, expr_t expr)
     ret.type_tag = assign_stmt_ast;
     ret.name = ident.name;
     assert(ret.name != NULL);
-    expr_t *p = (expr_t *) malloc(sizeof(expr_t));
-    if (p == NULL) {
-	bail_with_error("Unable to allocate space for a %s!", "expr_t");
-    }
+    expr_t *p = (expr_t *) arena_alloc(sizeof(expr_t));
     *p = expr;
     ret.expr = p;
     assert(ret.expr != NULL);
@@ -435,14 +391,12 @@ stmt_list_t ast_stmt_list_singleton(stmt_t stmt) {
     ret.type_tag = stmt_list_ast;
     stmt.next = NULL;
     // copy stmt to the heap
-    stmt_t *p = (stmt_t *) malloc(sizeof(stmt_t));	
-    if (p == NULL) {							
-	bail_with_error("Unable to allocate space for a %s!", "stmt_t"); 
-    }		    
+    stmt_t *p = (stmt_t *) arena_alloc(sizeof(stmt_t));	
     *p = stmt;
     p->next = NULL;
     // there will be no statments after stmt in the list
     ret.start = p;					
+    ret.last = p;
     return ret;
 }
 
@@ -451,15 +405,12 @@ extern stmt_list_t ast_stmt_list(stmt_list_t stmt_list, stmt_t stmt) {
     // debug_print("Entering ast_stmt_list...\n");
     stmt_list_t ret = stmt_list;
     // copy stmt to the heap
-    stmt_t *s = (stmt_t *) malloc(sizeof(stmt_t));
-    if (s == NULL) {
-	bail_with_error("Cannot allocate space for %s!", "stmt_t");
-    }
+    stmt_t *s = (stmt_t *) arena_alloc(sizeof(stmt_t));
     *s = stmt;
     s->next = NULL;
-    stmt_t *last = ast_last_list_elem(ret.start);
-    assert(last != NULL); // because there are no empty lists of stmts
-    last->next = s;
+    assert(ret.last != NULL); // because there are no empty lists of stmts
+    ret.last->next = s;
+    ret.last = s;
     return ret;
 }
 
@@ -602,19 +553,13 @@ binary_op_expr_t ast_binary_op_expr(expr_t expr1, token_t arith_op,
     ret.file_loc = expr1.file_loc;
     ret.type_tag = binary_op_expr_ast;
 
-    expr_t *p = (expr_t *) malloc(sizeof(expr_t));
-    if (p == NULL) {
-	bail_with_error("Unable to allocate space for a %s!", "expr_t");
-    }
+    expr_t *p = (expr_t *) arena_alloc(sizeof(expr_t));
     *p = expr1;
     ret.expr1 = p;
 
     ret.arith_op = arith_op;
     
-    p = (expr_t *) malloc(sizeof(expr_t));
-    if (p == NULL) {
-	bail_with_error("Unable to allocate space for a %s!", "expr_t");
-    }
+    p = (expr_t *) arena_alloc(sizeof(expr_t));
     *p = expr2;
     ret.expr2 = p;
 
@@ -778,3 +723,31 @@ bool ast_list_is_empty(void *lst)
 {
     return lst == NULL;
 }
+
+// Requires: e1 and e2 have been scope checked
+// Return true just when e1 and e2 are the same expression,
+// with their identifiers referring to the same declarations
+bool ast_expr_equal(expr_t e1, expr_t e2)
+{
+    if (e1.expr_kind != e2.expr_kind) {
+	return false;
+    }
+    switch (e1.expr_kind) {
+    case expr_bin:
+	return e1.data.binary.arith_op.code == e2.data.binary.arith_op.code
+	    && ast_expr_equal(*(e1.data.binary.expr1), *(e2.data.binary.expr1))
+	    && ast_expr_equal(*(e1.data.binary.expr2), *(e2.data.binary.expr2));
+    case expr_negated:
+	return ast_expr_equal(*(e1.data.negated.expr), *(e2.data.negated.expr));
+    case expr_ident:
+	assert(e1.data.ident.idu != NULL && e2.data.ident.idu != NULL);
+	return id_use_get_attrs(e1.data.ident.idu)
+	    == id_use_get_attrs(e2.data.ident.idu);
+    case expr_number:
+	return e1.data.number.value == e2.data.number.value;
+    default:
+	bail_with_error("Unexpected expr_kind_e (%d) in ast_expr_equal",
+			e1.expr_kind);
+	return false;
+    }
+}
@@ -141,6 +141,7 @@ typedef struct {
     file_location *file_loc;
     AST_type type_tag;
     struct stmt_s *start;
+    struct stmt_s *last;  // the last statement, so appending is fast
 } stmt_list_t;
 
 typedef enum { empty_stmts_e, stmt_list_e } stmts_kind_e;
@@ -534,4 +535,9 @@ extern int ast_list_length(void *lst);
 // Is lst empty?
 extern bool ast_list_is_empty(void *lst);
 
+// Requires: e1 and e2 have been scope checked
+// Return true just when e1 and e2 are the same expression,
+// with their identifiers referring to the same declarations
+extern bool ast_expr_equal(expr_t e1, expr_t e2);
+
 #endif
@@ -5,6 +5,7 @@
 #include "utilities.h"
 #include "code.h"
 #include "regname.h"
+#include "arena.h"
 
 // Return a fresh code struct, with next pointer NULL
 // containing the given instruction instr.
@@ -12,10 +13,7 @@
 // so this will never return NULL.
 static code *code_create(bin_instr_t instr)
 {
-    code *ret = (code *)malloc(sizeof(code));
-    if (ret == NULL) {
-	bail_with_error("Not enough space to allocate a code struct!");
-    }
+    code *ret = (code *)arena_alloc(sizeof(code));
     ret->next = NULL;
     ret->instr = instr;
     return ret;
@@ -225,7 +223,7 @@ code *code_sll(reg_num_type t, offset_type o, shift_type h)
 // with the named mnemonic and parameters
 code *code_srl(reg_num_type t, offset_type o, shift_type h)
 {
-    return create_other_comp_instr(t, o, h, SLL_F);
+    return create_other_comp_instr(t, o, h, SRL_F);
 }
 
 // Create and return a fresh instruction
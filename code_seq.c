@@ -10,6 +10,8 @@ static void code_seq_okay(code_seq seq)
 {
     // seq.first and seq.last are either both null or both not null
     assert((seq.first == NULL) == (seq.last == NULL));
+    // and only an empty seq has length 0
+    assert((seq.first == NULL) == (seq.length == 0));
 }
 
 // Return an empty code_seq
@@ -18,6 +20,7 @@ code_seq code_seq_empty()
     code_seq ret;
     ret.first = NULL;
     ret.last = NULL;
+    ret.length = 0;
     code_seq_okay(ret);
     return ret;
 }
@@ -29,6 +32,7 @@ code_seq code_seq_singleton(code *c)
     code_seq ret;
     ret.first = c;
     ret.last = c;
+    ret.length = 1;
     code_seq_okay(ret);
     return ret;
 }
@@ -63,6 +67,7 @@ code_seq code_seq_rest(code_seq seq)
     } else {
 	ret.last = seq.last;
     }
+    ret.length = seq.length - 1;
     code_seq_okay(ret);
     return ret;
 }
@@ -70,12 +75,8 @@ code_seq code_seq_rest(code_seq seq)
 // Return the size (number of instructions/words) in seq
 unsigned int code_seq_size(code_seq seq)
 {
-    unsigned int ret = 0;
-    while (!code_seq_is_empty(seq)) {
-	ret++;
-	seq = code_seq_rest(seq);
-    }
-    return ret;
+    code_seq_okay(seq);
+    return seq.length;
 }
 
 // Requires: !code_seq_is_empty(seq)
@@ -101,6 +102,7 @@ void code_seq_add_to_end(code_seq *seq, code *c)
 	c->next = NULL;
 	seq->last = c;
     }
+    seq->length++;
     code_seq_okay(*seq);
 }
 
@@ -111,6 +113,7 @@ void code_seq_concat(code_seq *s1, code_seq s2)
     if (code_seq_is_empty(*s1)) {
 	s1->first = s2.first;
 	s1->last = s2.last;
+	s1->length = s2.length;
     } else if (code_seq_is_empty(s2)) {
         ; // s1 is already their concatenation
     } else {
@@ -118,6 +121,7 @@ void code_seq_concat(code_seq *s1, code_seq s2)
 	// assert(last != NULL);
 	last->next = s2.first;
 	s1->last = s2.last;
+	s1->length += s2.length;
     }
     code_seq_okay(*s1);
 }
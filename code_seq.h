@@ -6,9 +6,11 @@
 
 // code sequences are linked lists
 // with an additional last pointer to the last node
+// and the number of nodes (so code_seq_size takes constant time)
 typedef struct {
     code *first;
     code *last;
+    unsigned int length;
 } code_seq;
 
 // Return an empty code_seq
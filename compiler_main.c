@@ -10,6 +10,9 @@
 #include "utilities.h"
 #include "symtab.h"
 #include "scope_check.h"
+#include "arena.h"
+#include "peephole.h"
+#include "const_fold.h"
 
 // The functions gen_code_initialize and gen_code_program
 // would normally be declared in gen_code.h,
@@ -23,6 +26,10 @@ extern void gen_code_initialize();
 // Generate code for prog into bf
 extern void gen_code_program(BOFFILE bf, block_t prog);
 
+// Turn the code generator's optimizations (strength reduction,
+// loop-invariant hoisting and common subexpression reuse) on or off
+extern void gen_code_set_optimizing(bool on);
+
 /* Print a usage message on stderr 
    and exit with failure. */
 static void usage(const char *cmdname)
@@ -30,7 +37,7 @@ static void usage(const char *cmdname)
     fprintf(stderr, "Usage: %s %s\n       %s %s\n       %s %s\n",
 	    cmdname, "-l codeFilename.spl",
 	    cmdname, "-u codeFilename.spl",
-	    cmdname, " codeFilename.spl"
+	    cmdname, "[-O0] codeFilename.spl"
 	    );
     exit(EXIT_FAILURE);
 }
@@ -44,10 +51,12 @@ int main(int argc, char *argv[])
     bool lexer_print_output = false;
     // should the unparse of the AST be shown?
     bool parser_unparse = false;
+    // should the code be optimized?
+    bool optimize = true;
     const char *cmdname = argv[0];
     argc--;
     argv++;
-    // possible options: -l, and -u
+    // possible options: -l, -u, and -O0 (which turns off optimization)
     while (argc > 0 && strlen(argv[0]) >= 2 && argv[0][0] == '-') {
 	if (strcmp(argv[0],"-l") == 0) {
 	    lexer_print_output = true;
@@ -57,6 +66,10 @@ int main(int argc, char *argv[])
 	    parser_unparse = true;
 	    argc--;
 	    argv++;
+	} else if (strcmp(argv[0],"-O0") == 0) {
+	    optimize = false;
+	    argc--;
+	    argv++;
 	} else {
 	    // bad option!
 	    usage(cmdname);
@@ -111,10 +124,20 @@ int main(int argc, char *argv[])
 	return EXIT_SUCCESS;
     }
 
+    if (optimize) {
+	// replace constant expressions with their values
+	const_fold_program(&progast);
+    } else {
+	peephole_set_rules(0);
+	gen_code_set_optimizing(false);
+    }
+
     // generate code from the ASTs
     gen_code_initialize();
     BOFFILE bf = bof_write_open(boffilename);
     gen_code_program(bf, progast);
 
+    // the ASTs and code are no longer needed
+    arena_free_all();
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <limits.h>
+#include "ast.h"
+#include "id_use.h"
+#include "id_attrs.h"
+#include "spl.tab.h"
+#include "arena.h"
+#include "utilities.h"
+#include "const_fold.h"
+
+// The blocks that enclose the AST being folded, innermost first,
+// used to find the definitions of constants
+typedef struct const_scope_s {
+    block_t *block;
+    struct const_scope_s *outer;
+} const_scope;
+
+static const_scope *current_scope = NULL;
+
+static void const_fold_block(block_t *blk);
+static void const_fold_stmts(stmts_t *stmts);
+static void const_fold_expr(expr_t *exp);
+
+// Requires: prog != NULL and prog has been scope checked
+// (so the id_use fields in its ASTs are set).
+// Modify the given AST so that each use of a constant is replaced
+// by the constant's value, and each arithmetic expression whose
+// operands are all numbers is replaced by its value.
+// The numbers in a chain of additions and subtractions are also
+// added together (so c + i + 4, with c = 48, becomes i + 52).
+// (Division by zero is not folded, so it remains a runtime error.)
+void const_fold_program(block_t *prog)
+{
+    const_fold_block(prog);
+}
+
+// Fold the procedures and statements in blk
+static void const_fold_block(block_t *blk)
+{
+    const_scope scope = { blk, current_scope };
+    current_scope = &scope;
+    proc_decl_t *pd = blk->proc_decls.proc_decls;
+    while (pd != NULL) {
+	const_fold_block(pd->block);
+	pd = pd->next;
+    }
+    const_fold_stmts(&(blk->stmts));
+    current_scope = scope.outer;
+}
+
+// Return the definition of the constant used by idu
+// (constants are the first names declared in their block,
+// in order, so the offset_count of its attributes is its position
+// among the block's const-defs)
+static const_def_t *const_definition(id_use *idu)
+{
+    const_scope *scope = current_scope;
+    for (unsigned int lev = 0; lev < idu->levelsOutward; lev++) {
+	assert(scope != NULL);
+	scope = scope->outer;
+    }
+    assert(scope != NULL);
+    unsigned int count = id_use_get_attrs(idu)->offset_count;
+    const_decl_t *cd = scope->block->const_decls.start;
+    while (cd != NULL) {
+	const_def_t *def = cd->const_def_list.start;
+	while (def != NULL) {
+	    if (count == 0) {
+		return def;
+	    }
+	    count--;
+	    def = def->next;
+	}
+	cd = cd->next;
+    }
+    bail_with_error("Cannot find the definition of a constant!");
+    return NULL;
+}
+
+// Return a number AST for value, at the file location floc
+static number_t folded_number(file_location *floc, word_type value)
+{
+    char text[32];
+    sprintf(text, "%d", value);
+    number_t ret;
+    ret.file_loc = floc;
+    ret.type_tag = number_ast;
+    ret.text = arena_strdup(text);
+    ret.value = value;
+    return ret;
+}
+
+// Is exp an addition or subtraction?
+static bool is_add_or_sub(expr_t *exp)
+{
+    return exp->expr_kind == expr_bin
+	&& (exp->data.binary.arith_op.code == plussym
+	    || exp->data.binary.arith_op.code == minussym);
+}
+
+// Return an expression for e1 op e2, where op is plussym or minussym,
+// using the file location of like for it and its operator
+static expr_t folded_add_or_sub(expr_t *like, expr_t e1, int op, expr_t e2)
+{
+    token_t tok = like->data.binary.arith_op;
+    tok.code = op;
+    tok.text = (op == plussym) ? "+" : "-";
+    expr_t ret = ast_expr_binary_op(ast_binary_op_expr(e1, tok, e2));
+    ret.file_loc = like->file_loc;
+    return ret;
+}
+
+// the most terms of a chain of additions and subtractions
+// that are looked at by const_fold_chain
+#define MAX_CHAIN_TERMS 64
+
+// Requires: is_add_or_sub(exp) and the operands of exp have been folded
+// If exp is a chain of additions and subtractions
+// (such as c + i + 4, which is parsed as (c + i) + 4)
+// with more than one number among its terms, replace it by the chain
+// of its other terms (in order), followed by the sum of those numbers
+// (arithmetic wraps around, so the terms can be reordered)
+static void const_fold_chain(expr_t *exp)
+{
+    // the terms, from the last to the first
+    expr_t *terms[MAX_CHAIN_TERMS];
+    bool subtracted[MAX_CHAIN_TERMS];
+    unsigned int count = 0;
+    expr_t *e = exp;
+    while (is_add_or_sub(e) && count < MAX_CHAIN_TERMS - 1) {
+	terms[count] = e->data.binary.expr2;
+	subtracted[count] = (e->data.binary.arith_op.code == minussym);
+	count++;
+	e = e->data.binary.expr1;
+    }
+    terms[count] = e;
+    subtracted[count] = false;
+    count++;
+
+    unsigned int numbers = 0;
+    uword_type sum = 0;
+    for (unsigned int i = 0; i < count; i++) {
+	if (terms[i]->expr_kind == expr_number) {
+	    uword_type v = (uword_type) terms[i]->data.number.value;
+	    sum = subtracted[i] ? sum - v : sum + v;
+	    numbers++;
+	}
+    }
+    if (numbers < 2) {
+	return;
+    }
+
+    expr_t ret;
+    bool started = false;
+    bool sum_used = false;
+    for (int i = count - 1; i >= 0; i--) {
+	if (terms[i]->expr_kind == expr_number) {
+	    continue;
+	}
+	if (started) {
+	    ret = folded_add_or_sub(exp, ret,
+				    subtracted[i] ? minussym : plussym,
+				    *terms[i]);
+	} else if (subtracted[i]) {
+	    // the first term left is subtracted, so start with the sum
+	    ret = folded_add_or_sub(exp,
+				    ast_expr_number(folded_number(exp->file_loc,
+								  (word_type) sum)),
+				    minussym, *terms[i]);
+	    sum_used = true;
+	} else {
+	    ret = *terms[i];
+	}
+	started = true;
+    }
+    assert(started);  // a chain of numbers only is already folded
+    word_type k = (word_type) sum;
+    if (!sum_used && k != 0) {
+	if (k < 0 && k != INT_MIN) {
+	    ret = folded_add_or_sub(exp, ret, minussym,
+			    ast_expr_number(folded_number(exp->file_loc, -k)));
+	} else {
+	    ret = folded_add_or_sub(exp, ret, plussym,
+			    ast_expr_number(folded_number(exp->file_loc, k)));
+	}
+    }
+    *exp = ret;
+}
+
+// Requires: exp->expr_kind == expr_bin
+// Fold the operands of the binary expression exp,
+// and replace exp by its value if they are both numbers
+// (arithmetic wraps around, as in the VM),
+// or else fold the numbers in its chain of additions and subtractions
+static void const_fold_binary_op_expr(expr_t *exp)
+{
+    binary_op_expr_t *bin = &(exp->data.binary);
+    const_fold_expr(bin->expr1);
+    const_fold_expr(bin->expr2);
+    if (bin->expr1->expr_kind != expr_number
+	|| bin->expr2->expr_kind != expr_number) {
+	if (is_add_or_sub(exp)) {
+	    const_fold_chain(exp);
+	}
+	return;
+    }
+    word_type v1 = bin->expr1->data.number.value;
+    word_type v2 = bin->expr2->data.number.value;
+    word_type result;
+    switch (bin->arith_op.code) {
+    case plussym:
+	result = (word_type) ((uword_type) v1 + (uword_type) v2);
+	break;
+    case minussym:
+	result = (word_type) ((uword_type) v1 - (uword_type) v2);
+	break;
+    case multsym:
+	result = (word_type) ((uword_type) v1 * (uword_type) v2);
+	break;
+    case divsym:
+	if (v2 == 0 || (v1 == INT_MIN && v2 == -1)) {
+	    // leave the error (or overflow) for the VM to report
+	    return;
+	}
+	result = v1 / v2;
+	break;
+    default:
+	bail_with_error("Unexpected arith_op (%d) in const_fold_binary_op_expr!",
+			bin->arith_op.code);
+	return;
+    }
+    *exp = ast_expr_number(folded_number(exp->file_loc, result));
+}
+
+// Fold the expression exp (in place)
+static void const_fold_expr(expr_t *exp)
+{
+    switch (exp->expr_kind) {
+    case expr_bin:
+	const_fold_binary_op_expr(exp);
+	break;
+    case expr_negated:
+	const_fold_expr(exp->data.negated.expr);
+	if (exp->data.negated.expr->expr_kind == expr_number) {
+	    word_type v = exp->data.negated.expr->data.number.value;
+	    *exp = ast_expr_number(folded_number(exp->file_loc,
+				   (word_type) (- (uword_type) v)));
+	}
+	break;
+    case expr_ident:
+	assert(exp->data.ident.idu != NULL);
+	if (id_use_get_attrs(exp->data.ident.idu)->kind == constant_idk) {
+	    // use the constant's own number (so its literal is shared)
+	    number_t num
+		= const_definition(exp->data.ident.idu)->number;
+	    num.file_loc = exp->file_loc;
+	    *exp = ast_expr_number(num);
+	}
+	break;
+    case expr_number:
+	break;
+    default:
+	bail_with_error("Unexpected expr_kind (%d) in const_fold_expr!",
+			exp->expr_kind);
+	break;
+    }
+}
+
+// Fold the expressions in the condition cond
+static void const_fold_condition(condition_t *cond)
+{
+    switch (cond->cond_kind) {
+    case ck_db:
+	const_fold_expr(&(cond->data.db_cond.dividend));
+	const_fold_expr(&(cond->data.db_cond.divisor));
+	break;
+    case ck_rel:
+	const_fold_expr(&(cond->data.rel_op_cond.expr1));
+	const_fold_expr(&(cond->data.rel_op_cond.expr2));
+	break;
+    default:
+	bail_with_error("Unexpected cond_kind (%d) in const_fold_condition!",
+			cond->cond_kind);
+	break;
+    }
+}
+
+// Fold the expressions in the statement stmt
+static void const_fold_stmt(stmt_t *stmt)
+{
+    switch (stmt->stmt_kind) {
+    case assign_stmt:
+	const_fold_expr(stmt->data.assign_stmt.expr);
+	break;
+    case call_stmt: case read_stmt:
+	break;
+    case if_stmt:
+	const_fold_condition(&(stmt->data.if_stmt.condition));
+	const_fold_stmts(stmt->data.if_stmt.then_stmts);
+	if (stmt->data.if_stmt.else_stmts != NULL) {
+	    const_fold_stmts(stmt->data.if_stmt.else_stmts);
+	}
+	break;
+    case while_stmt:
+	const_fold_condition(&(stmt->data.while_stmt.condition));
+	const_fold_stmts(stmt->data.while_stmt.body);
+	break;
+    case print_stmt:
+	const_fold_expr(&(stmt->data.print_stmt.expr));
+	break;
+    case block_stmt:
+	const_fold_block(stmt->data.block_stmt.block);
+	break;
+    default:
+	bail_with_error("Unknown stmt_kind (%d) in const_fold_stmt!",
+			stmt->stmt_kind);
+	break;
+    }
+}
+
+// Fold the expressions in the statements stmts
+static void const_fold_stmts(stmts_t *stmts)
+{
+    if (stmts->stmts_kind == empty_stmts_e) {
+	return;
+    }
+    stmt_t *s = stmts->stmt_list.start;
+    while (s != NULL) {
+	const_fold_stmt(s);
+	s = s->next;
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef _CONST_FOLD_H
+#define _CONST_FOLD_H
+#include "ast.h"
+
+// Requires: prog != NULL and prog has been scope checked
+// (so the id_use fields in its ASTs are set).
+// Modify the given AST so that each use of a constant is replaced
+// by the constant's value, and each arithmetic expression whose
+// operands are all numbers is replaced by its value.
+// (Division by zero is not folded, so it remains a runtime error.)
+extern void const_fold_program(block_t *prog);
+
+#endif
@@ -0,0 +1,174 @@
+#include <stdbool.h>
+#include "ast.h"
+#include "id_use.h"
+#include "id_attrs.h"
+#include "cse.h"
+
+// The expressions whose values are available
+static expr_t **avail_exprs;
+static unsigned int avail_count;
+
+// The expressions chosen so far by cse_reused_exprs
+static expr_t **chosen;
+static unsigned int chosen_count;
+static unsigned int chosen_max;
+
+// Is stmt a straight-line statement (an assignment, read or print)?
+bool cse_is_straight_line(stmt_t *stmt)
+{
+    switch (stmt->stmt_kind) {
+    case assign_stmt: case read_stmt: case print_stmt:
+	return true;
+    default:
+	return false;
+    }
+}
+
+// Return (a pointer to) the expression in the straight-line
+// statement stmt, or NULL if it has none
+static expr_t *stmt_expr(stmt_t *stmt)
+{
+    switch (stmt->stmt_kind) {
+    case assign_stmt:
+	return stmt->data.assign_stmt.expr;
+    case print_stmt:
+	return &(stmt->data.print_stmt.expr);
+    default:
+	return NULL;
+    }
+}
+
+// Return the attributes of the variable assigned (or read into)
+// by the straight-line statement stmt, or NULL if it assigns none
+static id_attrs *stmt_assigned_var(stmt_t *stmt)
+{
+    switch (stmt->stmt_kind) {
+    case assign_stmt:
+	return id_use_get_attrs(stmt->data.assign_stmt.idu);
+    case read_stmt:
+	return id_use_get_attrs(stmt->data.read_stmt.idu);
+    default:
+	return NULL;
+    }
+}
+
+// Does exp use the variable with attributes attrs?
+bool cse_uses_var(expr_t exp, id_attrs *attrs)
+{
+    switch (exp.expr_kind) {
+    case expr_bin:
+	return cse_uses_var(*(exp.data.binary.expr1), attrs)
+	    || cse_uses_var(*(exp.data.binary.expr2), attrs);
+    case expr_negated:
+	return cse_uses_var(*(exp.data.negated.expr), attrs);
+    case expr_ident:
+	return id_use_get_attrs(exp.data.ident.idu) == attrs;
+    default: // numbers
+	return false;
+    }
+}
+
+// Is exp the same as an available or chosen expression
+// (so that it will not be evaluated again)?
+static bool is_known(expr_t exp)
+{
+    for (unsigned int i = 0; i < avail_count; i++) {
+	if (avail_exprs[i] != NULL && ast_expr_equal(*(avail_exprs[i]), exp)) {
+	    return true;
+	}
+    }
+    for (unsigned int i = 0; i < chosen_count; i++) {
+	if (ast_expr_equal(*(chosen[i]), exp)) {
+	    return true;
+	}
+    }
+    return false;
+}
+
+// Return the number of evaluations of the expression *e in *x,
+// not counting (the node) e itself,
+// nor evaluations inside known expressions (which are not evaluated)
+static unsigned int count_evaluations(expr_t *e, expr_t *x)
+{
+    if (x == e || x->expr_kind == expr_ident || x->expr_kind == expr_number) {
+	return 0;
+    }
+    if (ast_expr_equal(*e, *x)) {
+	return 1;
+    }
+    if (is_known(*x)) {
+	return 0;
+    }
+    if (x->expr_kind == expr_bin) {
+	return count_evaluations(e, x->data.binary.expr1)
+	    + count_evaluations(e, x->data.binary.expr2);
+    }
+    return count_evaluations(e, x->data.negated.expr);
+}
+
+// Is *e (which is in stmt) evaluated again in stmt or in the
+// straight-line statements (in the window) that follow it,
+// before one of the variables it uses is assigned?
+static bool is_reused(expr_t *e, stmt_t *stmt)
+{
+    unsigned int looked_at = 0;
+    for (stmt_t *sp = stmt;
+	 sp != NULL && cse_is_straight_line(sp) && looked_at <= CSE_WINDOW;
+	 sp = sp->next, looked_at++) {
+	expr_t *x = stmt_expr(sp);
+	if (x != NULL && count_evaluations(e, x) > 0) {
+	    return true;
+	}
+	// the statement's expression is evaluated before the assignment
+	id_attrs *var = stmt_assigned_var(sp);
+	if (var != NULL && cse_uses_var(*e, var)) {
+	    return false;
+	}
+    }
+    return false;
+}
+
+// Add the largest subexpressions of *x that are reused
+// (and not known) to the chosen expressions
+static void choose_reused(expr_t *x, stmt_t *stmt)
+{
+    if (chosen_count == chosen_max
+	|| x->expr_kind == expr_ident || x->expr_kind == expr_number
+	|| is_known(*x)) {
+	return;
+    }
+    if (is_reused(x, stmt)) {
+	chosen[chosen_count++] = x;
+	return;
+    }
+    if (x->expr_kind == expr_bin) {
+	choose_reused(x->data.binary.expr1, stmt);
+	choose_reused(x->data.binary.expr2, stmt);
+    } else {
+	choose_reused(x->data.negated.expr, stmt);
+    }
+}
+
+// Requires: stmt and the statements after it have been scope checked,
+// and the values of the num_avail expressions in avail are available.
+// Put in exprs (up to max of them) the largest subexpressions of
+// stmt's expression, other than identifiers and numbers and
+// expressions the same as those in avail, that are evaluated again
+// later in stmt or in the straight-line statements that follow it
+// (before one of the variables they use is assigned).
+// Return the number of expressions put in exprs.
+unsigned int cse_reused_exprs(stmt_t *stmt,
+			      expr_t **avail, unsigned int num_avail,
+			      expr_t **exprs, unsigned int max)
+{
+    avail_exprs = avail;
+    avail_count = num_avail;
+    chosen = exprs;
+    chosen_count = 0;
+    chosen_max = max;
+    expr_t *x = stmt_expr(stmt);
+    if (x != NULL) {
+	choose_reused(x, stmt);
+    }
+    return chosen_count;
+}
@@ -0,0 +1,35 @@
+#ifndef _CSE_H
+#define _CSE_H
+#include <stdbool.h>
+#include "ast.h"
+#include "id_attrs.h"
+
+// Common subexpression elimination within runs of straight-line
+// statements (assignments, reads and prints, with no control flow):
+// finding the subexpressions whose values can be kept and used again
+// by later evaluations of the same expression in the run,
+// until one of the variables they use is assigned (or read into).
+
+// the most statements after a statement that are looked at
+// to find later uses of its subexpressions
+#define CSE_WINDOW 16
+
+// Is stmt a straight-line statement (an assignment, read or print)?
+extern bool cse_is_straight_line(stmt_t *stmt);
+
+// Requires: stmt and the statements after it have been scope checked,
+// and the values of the num_avail expressions in avail are available.
+// Put in exprs (up to max of them) the largest subexpressions of
+// stmt's expression, other than identifiers and numbers and
+// expressions the same as those in avail, that are evaluated again
+// later in stmt or in the straight-line statements that follow it
+// (before one of the variables they use is assigned).
+// Return the number of expressions put in exprs.
+extern unsigned int cse_reused_exprs(stmt_t *stmt,
+				     expr_t **avail, unsigned int num_avail,
+				     expr_t **exprs, unsigned int max);
+
+// Does exp use the variable with attributes attrs?
+extern bool cse_uses_var(expr_t exp, id_attrs *attrs);
+
+#endif
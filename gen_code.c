@@ -2,12 +2,114 @@
 
 #define STACK_SPACE 4096
 
+// should strength reduction, loop-invariant hoisting
+// and common subexpression reuse be done?
+static bool optimizing = true;
+
+// The number of temporaries needed by the statements of the block
+// whose code is being generated (see gen_code_expr)
+static unsigned int temps_needed = 0;
+
+// the most temporaries that can hold values of loop-invariant expressions
+#define MAX_HELD_TEMPS 32
+
+// The loop-invariant expressions of the loops (in the current block)
+// whose code is being generated: temporary i+1 holds the value of
+// held_exprs[i] while the code of the loops' conditions and bodies runs.
+// They are followed by the common subexpressions of the current run of
+// straight-line statements (see cse.h), whose values are put in their
+// temporaries where they are first evaluated (held_ready[i] tells if
+// that code has been generated). Entries that are no longer valid
+// (as a variable they use was assigned) are NULL.
+static expr_t *held_exprs[MAX_HELD_TEMPS];
+static bool held_ready[MAX_HELD_TEMPS];
+static unsigned int temps_held = 0;
+
+// The blocks whose code is being generated, innermost first,
+// with the offsets (from GP) of the words in the data section that hold
+// their constants and variables, in order of declaration
+// (so indexed by the offset_count of their attributes).
+// A constant is only entered in the literal table when it is first used
+// (so a constant whose uses were all folded takes no space);
+// until then its pending_literals entry is its number
+// (the entries for variables and entered constants are NULL)
+typedef struct gen_scope_s {
+    unsigned int *word_offsets;
+    number_t **pending_literals;
+    unsigned int decls_count;
+    struct gen_scope_s *outer;
+} gen_scope;
+
+static gen_scope *current_scope = NULL;
+
+static bool gen_code_db_uses_mask(db_condition_t cond);
+static code_seq gen_code_expr_value(expr_t expr, unsigned int target,
+                                    unsigned int first_free);
+
+// Return the first temporary that a statement can use as scratch space
+// after temporary 0 (the ones before it hold loop-invariant values)
+static unsigned int gen_code_scratch_temp() {
+    return temps_held + 1;
+}
+
+// Return the temporary holding the value of expr (at the start
+// of every statement), or 0 if there is none
+static unsigned int gen_code_held_temp(expr_t expr) {
+    if (expr.expr_kind == expr_ident || expr.expr_kind == expr_number) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < temps_held; i++) {
+        if (held_exprs[i] != NULL && ast_expr_equal(*held_exprs[i], expr)) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Return the temporary that the code from gen_code_expr_operand puts
+// the value of expr in: the one holding it, if any, otherwise target
+static unsigned int gen_code_operand_temp(expr_t expr, unsigned int target) {
+    unsigned int held = gen_code_held_temp(expr);
+    return (held != 0) ? held : target;
+}
+
+// Generate code that puts the value of expr in the temporary held
+// that holds it, if its value has not been put there already
+static code_seq gen_code_held_value(expr_t expr, unsigned int held,
+                                    unsigned int first_free) {
+    if (held_ready[held - 1]) {
+        return code_seq_empty();
+    }
+    held_ready[held - 1] = true;
+    return gen_code_expr_value(expr, held, first_free);
+}
+
+// Generate code that makes the value of expr available
+// in the temporary given by gen_code_operand_temp(expr, target)
+// (it is only evaluated if no temporary holds it)
+static code_seq gen_code_expr_operand(expr_t expr, unsigned int target,
+                                      unsigned int first_free) {
+    unsigned int held = gen_code_held_temp(expr);
+    if (held != 0) {
+        return gen_code_held_value(expr, held, first_free);
+    }
+    return gen_code_expr(expr, target, first_free);
+}
+
 // Initialize the code generator
 void gen_code_initialize()
 {
     literal_table_initialize();
 }
 
+// Turn the code generator's optimizations (strength reduction,
+// loop-invariant hoisting and common subexpression reuse) on or off
+// (they are on by default)
+void gen_code_set_optimizing(bool on)
+{
+    optimizing = on;
+}
+
 // Requires: bf if open for writing in binary
 // and prior to this scope checking and type checking have been done.
 // Write all the instructions in cs to bf in order
@@ -64,30 +166,82 @@ static void gen_code_output_program(BOFFILE bf, code_seq main_cs)
 // Generate code for prog into bf
 void gen_code_program(BOFFILE bf, block_t prog)
 {
-    code_seq main_cs = code_seq_empty();
-  //  printf("\n\nbegin \n\n");
-    
-    // Start with constant variable declarations
-    code_seq_concat(&main_cs, gen_code_const_decls(prog.const_decls));
- //   printf("\n\n const\n\n");
-    code_seq_concat(&main_cs, gen_code_var_decls(prog.var_decls));
-   // printf("\n\n var \n\n");
-    int vars_length = (code_seq_size(main_cs) / 2);
-    
-    code_seq_concat(&main_cs, code_utils_save_registers_for_AR());
+    code_seq main_cs = gen_code_block(prog);
+    code_seq_add_to_end(&main_cs, code_exit(0));
+    main_cs = peephole_optimize(main_cs);
+    gen_code_output_program(bf, main_cs);
+}
+
+// Return the number of constants and variables declared in blk
+static unsigned int gen_code_decls_count(block_t blk)
+{
+    unsigned int ret = 0;
+    for (const_decl_t *cd = blk.const_decls.start; cd != NULL; cd = cd->next) {
+        for (const_def_t *def = cd->const_def_list.start; def != NULL; def = def->next) {
+            ret++;
+        }
+    }
+    for (var_decl_t *vd = blk.var_decls.var_decls; vd != NULL; vd = vd->next) {
+        for (ident_t *id = vd->ident_list.start; id != NULL; id = id->next) {
+            ret++;
+        }
+    }
+    return ret;
+}
+
+// Generate code for the block blk: its constants and variables
+// are given words in the data section (the variables are zeroed
+// each time the block is entered), and its frame holds
+// the saved registers and the temporaries its statements need
+code_seq gen_code_block(block_t blk) {
+    gen_scope scope;
+    scope.word_offsets = arena_alloc(gen_code_decls_count(blk) * sizeof(unsigned int));
+    scope.pending_literals = arena_alloc(gen_code_decls_count(blk) * sizeof(number_t *));
+    scope.decls_count = 0;
+    scope.outer = current_scope;
+    current_scope = &scope;
+
+    // Start with constant and variable declarations
+    code_seq ret = gen_code_const_decls(blk.const_decls);
+    code_seq_concat(&ret, gen_code_var_decls(blk.var_decls));
+    code_seq_concat(&ret, code_utils_save_registers_for_AR());
 
     // Then do statements (assign, call, if, while, read, print, block)
-   // printf("\n\n stmts \n\n");
-    code_seq_concat(&main_cs, gen_code_stmts(prog.stmts));
-   // printf("\n\n  done with stmts \n\n");
-    code_seq_concat(&main_cs, code_utils_restore_registers_from_AR());
-   // printf("\n\n restored regs \n\n");
-    code_seq_concat(&main_cs, code_utils_deallocate_stack_space(vars_length));
-//printf("\n\n deallocated space \n\n");
-
-    code_seq_concat(&main_cs, code_utils_tear_down_program());
-   // printf("\n\n teardown \n\n");
-    gen_code_output_program(bf, main_cs);
+    // (the temporaries of enclosing blocks are not in this block's frame)
+    unsigned int outer_temps_needed = temps_needed;
+    unsigned int outer_temps_held = temps_held;
+    temps_needed = 0;
+    temps_held = 0;
+    code_seq body = gen_code_stmts(blk.stmts);
+    code_seq_concat(&ret, code_utils_allocate_stack_space(temps_needed));
+    code_seq_concat(&ret, body);
+    code_seq_concat(&ret, code_utils_deallocate_stack_space(temps_needed));
+    temps_needed = outer_temps_needed;
+    temps_held = outer_temps_held;
+
+    code_seq_concat(&ret, code_utils_restore_registers_from_AR());
+    current_scope = scope.outer;
+    return ret;
+}
+
+// Return the offset (from GP) of the word holding
+// the constant or variable used by idu
+// (entering the constant in the literal table if it is not there yet)
+static unsigned int gen_code_word_offset(id_use *idu) {
+    gen_scope *scope = current_scope;
+    for (unsigned int lev = 0; lev < idu->levelsOutward; lev++) {
+        assert(scope != NULL);
+        scope = scope->outer;
+    }
+    assert(scope != NULL);
+    unsigned int count = id_use_get_attrs(idu)->offset_count;
+    assert(count < scope->decls_count);
+    number_t *num = scope->pending_literals[count];
+    if (num != NULL) {
+        scope->word_offsets[count] = literal_table_lookup(num->text, num->value);
+        scope->pending_literals[count] = NULL;
+    }
+    return scope->word_offsets[count];
 }
 
 code_seq gen_code_var_decls(var_decls_t vds) {
@@ -136,56 +290,78 @@ code_seq gen_code_const_defs(const_def_list_t cds) {
 }
 
 code_seq gen_code_const_def(const_def_t cd) {
-    code_seq ret = code_seq_empty();
-//printf("\n\n constdef \n\n");
- //  code_seq_add_to_end(&ret, code_sri(SP, 1));
-
-   // code_seq_concat(&ret, gen_code_number(cd.number));
-   
-    
-    literal_table_lookup(cd.number.text , cd.number.value);     // literal_table_find_offset(cd.number.text, cd.number.value);
-  
-   
-   
-  // code_seq_add_to_end(&ret, code_swr(GP, noffset, SP));
-
-  //  code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-   
-   // code_seq_add_to_end(&ret, code_ari(SP, 1));
-
-    return ret;
+    // the constant's value is kept in the literal table,
+    // where it is entered by gen_code_word_offset when it is first used
+    number_t *num = arena_alloc(sizeof(number_t));
+    *num = cd.number;
+    current_scope->pending_literals[current_scope->decls_count++] = num;
+    return code_seq_empty();
 }
 
+// Give each of the variables in idents a word in the data section,
+// and generate code that sets it to 0 (which is done each time the
+// block is entered, as a block in a loop reuses the same words)
 code_seq gen_code_idents(ident_list_t idents) {
     code_seq ret = code_seq_empty();
-
-   // code_seq_add_to_end(&ret, code_sri(SP, 1));
-
     ident_t *ident = idents.start;
     while(ident != NULL){
-        int offset = literal_table_find_offset(ident->name, 0);
-        code_seq_add_to_end(&ret, code_swr(GP, offset, SP));
-      
-     // int offset = literal_table_find_offset(ident->name, 0);
-      //  if(offset == -1) bail_with_error("not in literal table");
-      
+        unsigned int offset = literal_table_reserve_word();
+        current_scope->pending_literals[current_scope->decls_count] = NULL;
+        current_scope->word_offsets[current_scope->decls_count++] = offset;
+        code_seq_add_to_end(&ret, code_lit(GP, offset, 0));
         ident = ident->next;
     }
-
-    // code_seq_add_to_end(&ret, code_ari(SP, 1));
     return ret;
 }
 
 // Generate code for the list of statments given by stmts to out
+// (the values of the common subexpressions of each run of
+// straight-line statements are kept in temporaries, see cse.h)
 code_seq gen_code_stmts(stmts_t stmts) {
     code_seq ret = code_seq_empty();
 
     if(stmts.stmts_kind != empty_stmts_e) {
+        unsigned int run_temps_held = temps_held;
         stmt_t* stmt = stmts.stmt_list.start;
         while(stmt != NULL) {
+            if (!cse_is_straight_line(stmt)) {
+                // the run ends, and so do the values kept for it
+                temps_held = run_temps_held;
+                code_seq_concat(&ret, gen_code_stmt(*stmt));
+                stmt = stmt->next;
+                continue;
+            }
+
+            // Holding the subexpressions that are used again later in the run
+            expr_t *reused[MAX_HELD_TEMPS];
+            unsigned int num_reused = 0;
+            if (optimizing) {
+                num_reused = cse_reused_exprs(stmt, held_exprs, temps_held,
+                                              reused, MAX_HELD_TEMPS - temps_held);
+            }
+            for (unsigned int i = 0; i < num_reused; i++) {
+                held_ready[temps_held] = false;
+                held_exprs[temps_held++] = reused[i];
+            }
+
             code_seq_concat(&ret, gen_code_stmt(*stmt));
+
+            // The values that use an assigned variable are no longer valid
+            id_use *assigned = NULL;
+            if (stmt->stmt_kind == assign_stmt) {
+                assigned = stmt->data.assign_stmt.idu;
+            } else if (stmt->stmt_kind == read_stmt) {
+                assigned = stmt->data.read_stmt.idu;
+            }
+            for (unsigned int i = run_temps_held; assigned != NULL && i < temps_held; i++) {
+                if (held_exprs[i] != NULL
+                    && cse_uses_var(*held_exprs[i], id_use_get_attrs(assigned))) {
+                    held_exprs[i] = NULL;
+                }
+            }
             stmt = stmt->next;
         }
+        temps_held = run_temps_held;
     }
 
     return ret;
@@ -222,12 +398,9 @@ code_seq gen_code_stmt(stmt_t stmt) {
 }
 
 code_seq gen_code_assign_stmt(assign_stmt_t stmt) {
-    code_seq ret = code_seq_empty();
-
-    code_seq_add_to_end(&ret, code_sri(SP, 1));
-    code_seq_concat(&ret, gen_code_expr(*stmt.expr));
+    code_seq ret = gen_code_expr(*stmt.expr, 0, gen_code_scratch_temp());
 
-    // Evaluation of expr is now at top of stack (SP).
+    // Evaluation of expr is now in temporary 0 (at SP).
     assert(stmt.idu != NULL);
     assert(id_use_get_attrs(stmt.idu) != NULL);
     id_kind kind = id_use_get_attrs(stmt.idu)->kind;
@@ -238,9 +411,9 @@ code_seq gen_code_assign_stmt(assign_stmt_t stmt) {
             return code_seq_empty();
         }
         case variable_idk: {
-            int offset = id_use_get_attrs(stmt.idu)->offset_count;
-            assert(offset < USHRT_MAX);
-            code_seq_add_to_end(&ret, code_cpw(SP, 0, GP, offset));
+            unsigned int offset = gen_code_word_offset(stmt.idu);
+            assert(offset < SHRT_MAX);
+            code_seq_add_to_end(&ret, code_cpw(GP, offset, SP, 0));
             break;
         }
         case procedure_idk: {
@@ -253,10 +426,6 @@ code_seq gen_code_assign_stmt(assign_stmt_t stmt) {
         }
     }
 
-
-    code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-    code_seq_add_to_end(&ret, code_ari(SP, 1));
-
     return ret;
 }
 
@@ -266,23 +435,20 @@ code_seq gen_code_call_stmt(call_stmt_t stmt) {
 }
 
 code_seq gen_code_if_stmt(if_stmt_t stmt) {
-    code_seq ret = code_seq_empty();
-
-    // SP = 1, and SP+1 should have the evaluation of the condition stored in it. (0 for false, 1 for true)
-
-    code_seq_concat(&ret, gen_code_condition(stmt.condition));
+    code_seq ret = gen_code_condition(stmt.condition);
 
     code_seq then_body = gen_code_stmts(*(stmt.then_stmts));
     code_seq else_body = code_seq_empty();
-    if(stmt.else_stmts->stmts_kind != empty_stmts_e) {
+    if(stmt.else_stmts != NULL && stmt.else_stmts->stmts_kind != empty_stmts_e) {
         else_body = gen_code_stmts(*(stmt.else_stmts));
 
         // Adding instruction to jump over else stmts at end of then statements.
-        code_seq_add_to_end(&then_body, code_beq(SP, 0, code_seq_size(else_body)+1));
+        code_seq_add_to_end(&then_body, code_jrel(code_seq_size(else_body)+1));
     } 
 
-    // Adding instruction to jump over then stmts. This instruction should be skipped if the condition evaluates to true.
-    code_seq_add_to_end(&ret, code_beq(SP, 0, code_seq_size(then_body)+1));
+    // Adding the branch over the then stmts, taken if the condition is false.
+    code_seq_add_to_end(&ret, gen_code_condition_branch(stmt.condition, false,
+                                                        code_seq_size(then_body)+1));
 
     // Adding then stmts
     code_seq_concat(&ret, then_body);
@@ -293,6 +459,8 @@ code_seq gen_code_if_stmt(if_stmt_t stmt) {
     return ret;
 }
 
+// Generate code that evaluates what the branch for cond compares
+// (see gen_code_condition_branch)
 code_seq gen_code_condition(condition_t cond) {
     switch(cond.cond_kind) {
         case ck_db: {
@@ -308,24 +476,99 @@ code_seq gen_code_condition(condition_t cond) {
     }
 }
 
+// Requires: the code from gen_code_condition(cond) was just executed.
+// Return a branch to offset instructions from it,
+// which is taken just when the value of cond is jump_when
+code *gen_code_condition_branch(condition_t cond, bool jump_when, int offset) {
+    switch(cond.cond_kind) {
+        case ck_db: {
+            if (gen_code_db_uses_mask(cond.data.db_cond)) {
+                // temporary 0 holds the (non-negative) masked dividend
+                return jump_when ? code_blez(SP, 0, offset) : code_bgtz(SP, 0, offset);
+            }
+            // temporary 0 holds the remainder and the first scratch temporary holds 0
+            unsigned int zero = gen_code_scratch_temp();
+            return jump_when ? code_beq(SP, zero, offset) : code_bne(SP, zero, offset);
+        }
+        case ck_rel: {
+            break;
+        }
+        default: {
+            bail_with_error("Invalid cond_kind. Code: %d", cond.cond_kind);
+            return NULL;
+        }
+    }
+
+    // temporary 0 holds expr1 and temporary expr2_temp holds expr2
+    unsigned int expr2_temp = gen_code_operand_temp(cond.data.rel_op_cond.expr2,
+                                                    gen_code_scratch_temp());
+    switch(cond.data.rel_op_cond.rel_op.code) {
+        case eqeqsym: {
+            return jump_when ? code_beq(SP, expr2_temp, offset) : code_bne(SP, expr2_temp, offset);
+        }
+        case neqsym: {
+            return jump_when ? code_bne(SP, expr2_temp, offset) : code_beq(SP, expr2_temp, offset);
+        }
+        // temporary 0 holds expr1 - expr2
+        case ltsym: {
+            return jump_when ? code_bltz(SP, 0, offset) : code_bgez(SP, 0, offset);
+        }
+        case leqsym: {
+            return jump_when ? code_blez(SP, 0, offset) : code_bgtz(SP, 0, offset);
+        }
+        case gtsym: {
+            return jump_when ? code_bgtz(SP, 0, offset) : code_blez(SP, 0, offset);
+        }
+        case geqsym: {
+            return jump_when ? code_bgez(SP, 0, offset) : code_bltz(SP, 0, offset);
+        }
+        default: {
+            bail_with_error("Invalid opcode. Code: %d", cond.data.rel_op_cond.rel_op.code);
+            return NULL;
+        }
+    }
+}
+
 code_seq gen_code_while_stmt(while_stmt_t stmt) {
+    // Computing the loop-invariant expressions (that are not already held)
+    // into temporaries, which hold them while the loop runs
+    unsigned int outer_temps_held = temps_held;
+    expr_t *invariants[MAX_HELD_TEMPS];
+    unsigned int num_invariants = 0;
+    if (optimizing) {
+        num_invariants
+            = loop_invariant_exprs(&stmt, invariants, MAX_HELD_TEMPS - temps_held);
+    }
     code_seq ret = code_seq_empty();
+    for (unsigned int i = 0; i < num_invariants; i++) {
+        if (gen_code_held_temp(*invariants[i]) == 0) {
+            unsigned int temp = gen_code_scratch_temp();
+            code_seq_concat(&ret, gen_code_expr(*invariants[i], temp, temp + 1));
+            held_ready[temps_held] = true;
+            held_exprs[temps_held++] = invariants[i];
+        }
+    }
 
     code_seq while_body = gen_code_stmts(*stmt.body);
+    code_seq cond = gen_code_condition(stmt.condition);
 
-    // Adding instruction to jump over the while body.
-    code_seq_add_to_end(&ret, code_beq(SP, 0, code_seq_size(while_body)+1));
+    // Adding instruction to jump over the while body to the condition.
+    code_seq_add_to_end(&ret, code_jrel(code_seq_size(while_body)+1));
 
     // Adding while body instructions (initially skipped)
     code_seq_concat(&ret, while_body);
 
     // Adding condition instructions after while body
-    code_seq_concat(&ret, gen_code_condition(stmt.condition));
+    int cond_size = code_seq_size(cond);
+    code_seq_concat(&ret, cond);
+
+    // Adding the branch back to the start of the while body, taken if the condition is true.
+    // (the branch uses the temporaries the condition code used,
+    // so the invariants are held until it is generated)
+    code_seq_add_to_end(&ret, gen_code_condition_branch(stmt.condition, true,
+                                                        -(code_seq_size(while_body) + cond_size)));
+    temps_held = outer_temps_held;
 
-    // Adding jump instruction to go back to beginning of while statement. This is skipped if condition is false.
-    code_seq_add_to_end(&ret, code_beq(SP, 0, 2));
-    code_seq_add_to_end(&ret, code_jrel(-1 * code_seq_size(ret)));
-    
     return ret;
 }
 
@@ -336,139 +579,40 @@ code_seq gen_code_read_stmt(read_stmt_t stmt) {
         return code_seq_empty();
     }
 
-    return code_seq_singleton(code_rch(GP, literal_table_lookup(name, stmt.idu->levelsOutward)));
+    unsigned int offset = gen_code_word_offset(stmt.idu);
+    assert(offset < SHRT_MAX);
+    return code_seq_singleton(code_rch(GP, offset));
 }
 
 code_seq gen_code_print_stmt(print_stmt_t stmt) {
-    code_seq ret = code_seq_empty();
-
-    code_seq_concat(&ret, gen_code_expr(stmt.expr));
+    code_seq ret = gen_code_expr(stmt.expr, 0, gen_code_scratch_temp());
     code_seq_add_to_end(&ret, code_pint(SP, 0));
 
     return ret;
 }
 
 code_seq gen_code_block_stmt(block_stmt_t stmt) {
-    // Start with constant and variable declarations
-    code_seq ret = gen_code_const_decls(stmt.block->const_decls);
-    code_seq_concat(&ret,  gen_code_var_decls(stmt.block->var_decls));
-    int vars_length = (code_seq_size(ret) / 2);
-    code_seq_concat(&ret, code_utils_save_registers_for_AR());
-
-    // Then do statements (assign, call, if, while, read, print, block)
-    code_seq_concat(&ret, gen_code_stmts(stmt.block->stmts));
-    code_seq_concat(&ret, code_utils_restore_registers_from_AR());
-    code_seq_concat(&ret, code_utils_deallocate_stack_space(vars_length));
-
-    code_seq_concat(&ret, code_utils_tear_down_program());
-
-    return ret;
+    return gen_code_block(*stmt.block);
 }
 
+// Generate code that puts expr1 in temporary 0 and expr2 in the first
+// scratch temporary, unless a temporary holds it (for == and !=),
+// or expr1 - expr2 in temporary 0 (for the other operators)
 code_seq gen_code_rel_op_condition(rel_op_condition_t cond) {
-    code_seq ret = code_seq_empty();
-
-    // Adding a space to the stack for expr2
-    code_seq_add_to_end(&ret, code_sri(SP, 1)); 
-
-    // Evaluating expr2 and putting its value at top of stack
-    code_seq_concat(&ret, gen_code_expr(cond.expr2));
-
-    // Adding a space to the stack for expr1
-    code_seq_add_to_end(&ret, code_sri(SP, 1)); 
-
-    // Evaluating expr1 and putting its value at top of stack
-    code_seq_concat(&ret, gen_code_expr(cond.expr1));
-
-    // top of stack (SP) should be expr1, and expr2 should be next.
+    // Evaluating expr2 into a scratch temporary and expr1 into temporary 0 (at SP)
+    unsigned int scratch = gen_code_scratch_temp();
+    unsigned int expr2_temp = gen_code_operand_temp(cond.expr2, scratch);
+    code_seq ret = gen_code_expr_operand(cond.expr2, scratch, scratch + 1);
+    code_seq_concat(&ret, gen_code_expr(cond.expr1, 0, scratch + 1));
 
     switch(cond.rel_op.code) {
-        case eqeqsym: {
-            // bottom of stack = expr1 - expr2
-            code_seq_add_to_end(&ret, code_sub(FP, 0, SP, 1));
-
-            // Removing both spaces from top of stack.
-            code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-            code_seq_add_to_end(&ret, code_ari(SP, 1));
-            code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-            code_seq_add_to_end(&ret, code_ari(SP, 1));
-
-            // If FP == 0, then expr1 must have been equal to expr2, which is true. So it skips the instruction that skips the then stmts.
-            code_seq_add_to_end(&ret, code_beq(FP, 0, 2));
-            break;
-        }
-        case neqsym: {
-            // [SP] = expr1 - expr2
-            code_seq_add_to_end(&ret, code_sub(FP, 0, SP, 1));
-
-            // Removing both spaces from top of stack.
-            code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-            code_seq_add_to_end(&ret, code_ari(SP, 1));
-            code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-            code_seq_add_to_end(&ret, code_ari(SP, 1));
-
-            // If FP != 0, then expr1 must have not been equal to expr2, which is true. So it skips the instruction that skips the then stmts.
-            code_seq_add_to_end(&ret, code_bne(FP, 0, 2));
-            break;
-        }
-        case ltsym: {
-            // [SP+2] = expr1 - expr2
-            code_seq_add_to_end(&ret, code_sub(FP, 0, SP, 1));
-
-            // Removing both spaces from top of stack.
-            code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-            code_seq_add_to_end(&ret, code_ari(SP, 1));
-            code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-            code_seq_add_to_end(&ret, code_ari(SP, 1));
-
-            // Top of stack should now have value of expr1 - expr2
-
-            // If FP < 0, then expr1 must have been less than expr2, which is true. So it skips the instruction that skips the then stmts.
-            code_seq_add_to_end(&ret, code_bltz(FP, 0, 2));
-            // If FP > 0, then expr1 must have been greater than expr2, which is false. So it doesn't skip the instruction that skips the then stmts.
-
-            break;
-        }
-        case leqsym: {
-            // [SP] = expr1 - expr2
-            code_seq_add_to_end(&ret, code_sub(FP, 0, SP, 1));
-
-            // Removing both spaces from top of stack.
-            code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-            code_seq_add_to_end(&ret, code_ari(SP, 1));
-            code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-            code_seq_add_to_end(&ret, code_ari(SP, 1));
-
-            // If FP <= 0, then expr1 must have been less than or equal to expr2, which is true. So it skips the instruction that skips the then stmts.
-            code_seq_add_to_end(&ret, code_blez(FP, 0, 2));
-            break;
-        }
-        case gtsym: {
-            // [SP] = expr1 - expr2
-            code_seq_add_to_end(&ret, code_sub(FP, 0, SP, 1));
-
-            // Removing both spaces from top of stack.
-            code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-            code_seq_add_to_end(&ret, code_ari(SP, 1));
-            code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-            code_seq_add_to_end(&ret, code_ari(SP, 1));
-
-            // If FP > 0, then expr1 must have been greater than expr2, which is true. So it skips the instruction that skips the then stmts.
-            code_seq_add_to_end(&ret, code_bgtz(FP, 0, 2));
+        case eqeqsym: case neqsym: {
+            // BEQ and BNE compare the words at SP and SP+expr2_temp
             break;
         }
-        case geqsym: {
+        case ltsym: case leqsym: case gtsym: case geqsym: {
             // [SP] = expr1 - expr2
-            code_seq_add_to_end(&ret, code_sub(FP, 0, SP, 1));
-
-            // Removing both spaces from top of stack.
-            code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-            code_seq_add_to_end(&ret, code_ari(SP, 1));
-            code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-            code_seq_add_to_end(&ret, code_ari(SP, 1));
-
-            // If FP >= 0, then expr1 must have been greater than or equal to expr2, which is true. So it skips the instruction that skips the then stmts.
-            code_seq_add_to_end(&ret, code_bgez(FP, 0, 2));
+            code_seq_add_to_end(&ret, code_sub(SP, 0, SP, expr2_temp));
             break;
         }
         default: {
@@ -480,50 +624,97 @@ code_seq gen_code_rel_op_condition(rel_op_condition_t cond) {
     return ret;
 }
 
+// Return k if expr is the number 2^k (for 0 <= k <= 30), otherwise -1
+static int gen_code_power_of_two(expr_t expr) {
+    if (expr.expr_kind != expr_number || expr.data.number.value <= 0) {
+        return -1;
+    }
+    word_type value = expr.data.number.value;
+    if ((value & (value - 1)) != 0) {
+        return -1;
+    }
+    int k = 0;
+    while (value > 1) {
+        value >>= 1;
+        k++;
+    }
+    return k;
+}
+
+// Is the divisor of cond 2^k, for a k that lets the test be done with
+// ANDI on the dividend's low k bits (whose mask fits in its immediate)?
+static bool gen_code_db_uses_mask(db_condition_t cond) {
+    int k = gen_code_power_of_two(cond.divisor);
+    return optimizing && 0 <= k && k <= 16;
+}
+
+// Generate code that puts the remainder of dividend / divisor
+// in temporary 0 and 0 in the first scratch temporary
+// (or, if the divisor is a small power of 2, the bits of the dividend
+// that must be 0 for it to be divisible in temporary 0)
 code_seq gen_code_db_condition(db_condition_t cond) {
-    code_seq ret = code_seq_empty();
-    //Make space for divisor
-    code_seq_add_to_end(&ret, code_sri(SP, 1));
-    
-    code_seq_concat(&ret, gen_code_expr(cond.divisor));
-    
-    //make space for dividends
-    code_seq_add_to_end(&ret, code_sri(SP,1));
-    
-    code_seq_concat(&ret, gen_code_expr(cond.dividend));
+    unsigned int scratch = gen_code_scratch_temp();
+    if (gen_code_db_uses_mask(cond)) {
+        code_seq ret = gen_code_expr(cond.dividend, 0, scratch);
+        uimmed_type mask = (1 << gen_code_power_of_two(cond.divisor)) - 1;
+        code_seq_add_to_end(&ret, code_andi(SP, 0, mask));
+        return ret;
+    }
+
+    // Evaluating the divisor into a scratch temporary and the dividend into temporary 0 (at SP)
+    unsigned int divisor_temp = gen_code_operand_temp(cond.divisor, scratch);
+    code_seq ret = gen_code_expr_operand(cond.divisor, scratch, scratch + 1);
+    code_seq_concat(&ret, gen_code_expr(cond.dividend, 0, scratch + 1));
+
+    code_seq_add_to_end(&ret, code_div(SP, divisor_temp));
+    code_seq_add_to_end(&ret, code_cfhi(SP, 0));
+    code_seq_add_to_end(&ret, code_lit(SP, scratch, 0));
 
-    code_seq_add_to_end(&ret, code_div(SP, 1));
-    
-    // Put remainder is space at bottom of stack
-    code_seq_add_to_end(&ret, code_cfhi(FP, 0));
-
-    // Removing spaces from top of stack
-    code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-    code_seq_add_to_end(&ret, code_ari(SP, 1));
-    code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-    code_seq_add_to_end(&ret, code_ari(SP, 1));
-    
-    // Top of stack should be 0
-    
-    // Skips the skipping of the then stmts if 0 = remainder (is divisible)
-    code_seq_add_to_end(&ret, code_beq(FP, 0, 2));
-    
     return ret;
 }
 
-code_seq gen_code_expr(expr_t expr) {
+// Generate code that puts the value of expr in the temporary at offset
+// target from SP, using temporary 0 and the temporaries at offsets
+// first_free and above as scratch space
+// (if a temporary holds the value of expr, it is copied from there)
+code_seq gen_code_expr(expr_t expr, unsigned int target, unsigned int first_free) {
+    unsigned int held = gen_code_held_temp(expr);
+    if (held == 0) {
+        return gen_code_expr_value(expr, target, first_free);
+    }
+    code_seq ret = gen_code_held_value(expr, held, first_free);
+    if (target != held) {
+        if (target >= temps_needed) {
+            temps_needed = target + 1;
+        }
+        code_seq_add_to_end(&ret, code_cpw(SP, target, SP, held));
+    }
+    return ret;
+}
+
+// Generate code that evaluates expr into the temporary at offset target
+// (see gen_code_expr)
+static code_seq gen_code_expr_value(expr_t expr, unsigned int target,
+                                    unsigned int first_free) {
+    if (first_free > NINEBITSMAXSIGNED) {
+        bail_with_error("Expression needs too many temporaries (more than %d)",
+                        NINEBITSMAXSIGNED);
+    }
+    if (target >= temps_needed) {
+        temps_needed = target + 1;
+    }
     switch(expr.expr_kind) {
         case expr_bin: {
-            return gen_code_binary_op_expr(expr.data.binary);
+            return gen_code_binary_op_expr(expr.data.binary, target, first_free);
         }
         case expr_negated: {
-            return gen_code_negated_expr(expr.data.negated);
+            return gen_code_negated_expr(expr.data.negated, target, first_free);
         }
         case expr_ident: {
-            return gen_code_ident(expr.data.ident);
+            return gen_code_ident(expr.data.ident, target);
         }
         case expr_number: {
-            return gen_code_number(expr.data.number);
+            return gen_code_number(expr.data.number, target);
         }
         default: {
             bail_with_error("Invalid expr_kind. Code: %d", expr.expr_kind);
@@ -532,38 +723,49 @@ code_seq gen_code_expr(expr_t expr) {
     }
 }
 
-code_seq gen_code_binary_op_expr(binary_op_expr_t bin) {
-    code_seq ret = code_seq_empty();
-    
-    // Adding a space to the stack for expr2
-    code_seq_add_to_end(&ret, code_sri(SP, 1));
-
-    // Evaluating expr2 and putting its value at top of stack
-    code_seq_concat(&ret, gen_code_expr(*bin.expr2));
-
-    // Adding a space to the stack for expr1
-    code_seq_add_to_end(&ret, code_sri(SP, 1));
+code_seq gen_code_binary_op_expr(binary_op_expr_t bin, unsigned int target, unsigned int first_free) {
+    // Multiplying by 2^k is done with a left shift
+    // (dividing by 2^k is not, as a right shift would be wrong
+    // for negative dividends and the VM has no arithmetic shift)
+    if (optimizing && bin.arith_op.code == multsym) {
+        expr_t *operand = bin.expr1;
+        int shift = gen_code_power_of_two(*bin.expr2);
+        if (shift < 0) {
+            operand = bin.expr2;
+            shift = gen_code_power_of_two(*bin.expr1);
+        }
+        if (shift >= 0) {
+            // SLL shifts the word at SP, so the operand goes in temporary 0
+            code_seq ret = gen_code_expr(*operand, 0, first_free);
+            code_seq_add_to_end(&ret, code_sll(SP, target, shift));
+            return ret;
+        }
+    }
 
-    // Evaluating expr1 and putting its value at top of stack
-    code_seq_concat(&ret, gen_code_expr(*bin.expr1));
+    // Evaluating expr2 into the first free temporary (unless a temporary holds it)
+    unsigned int expr2_temp = gen_code_operand_temp(*bin.expr2, first_free);
+    code_seq ret = gen_code_expr_operand(*bin.expr2, first_free, first_free + 1);
 
-    // top of stack (SP) should be expr1, and expr2 should be next.
+    // Evaluating expr1 into temporary 0 (at SP), as the instructions need it there
+    code_seq_concat(&ret, gen_code_expr(*bin.expr1, 0, first_free + 1));
 
     switch(bin.arith_op.code) {
         case plussym: {
-            code_seq_add_to_end(&ret, code_add(SP, 2, SP, 1));
+            code_seq_add_to_end(&ret, code_add(SP, target, SP, expr2_temp));
             break;
         }
         case minussym: {
-            code_seq_add_to_end(&ret, code_sub(SP, 2, SP, 1));
+            code_seq_add_to_end(&ret, code_sub(SP, target, SP, expr2_temp));
             break; 
         }
         case multsym: {
-            code_seq_add_to_end(&ret, code_mul(SP, 1));
+            code_seq_add_to_end(&ret, code_mul(SP, expr2_temp));
+            code_seq_add_to_end(&ret, code_cflo(SP, target));
             break;
         }
         case divsym: {
-            code_seq_add_to_end(&ret, code_div(SP, 1));
+            code_seq_add_to_end(&ret, code_div(SP, expr2_temp));
+            code_seq_add_to_end(&ret, code_cflo(SP, target));
             break;
         }
         default: {
@@ -571,38 +773,33 @@ code_seq gen_code_binary_op_expr(binary_op_expr_t bin) {
             return code_seq_empty();
         }
     }
-    code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-    code_seq_add_to_end(&ret, code_ari(SP, 1));
-    code_seq_add_to_end(&ret, code_sub(SP, 0, SP, 0));
-    code_seq_add_to_end(&ret, code_ari(SP, 1));
 
     return ret;
 }
 
-// Putting the value referenced by ident at the top of the stack
-code_seq gen_code_ident(ident_t ident) {
+// Putting the value referenced by ident in the temporary at offset target
+code_seq gen_code_ident(ident_t ident, unsigned int target) {
     assert(ident.idu != NULL);
-
-    code_seq ret = code_utils_compute_fp(SP, ident.idu->levelsOutward);
-
     assert(id_use_get_attrs(ident.idu) != NULL);
 
-    int offset = id_use_get_attrs(ident.idu)->offset_count;
-
-    assert(offset < USHRT_MAX); // making sure it fits
+    unsigned int offset = gen_code_word_offset(ident.idu);
 
-    code_seq_add_to_end(&ret, code_cpw(SP, 0,GP ,offset));
+    assert(offset < SHRT_MAX); // making sure it fits
 
-    return ret;
+    return code_seq_singleton(code_cpw(SP, target, GP, offset));
 }
-code_seq gen_code_number(number_t num){
+// Putting the number's value in the temporary at offset target
+// (values that fit in LIT's 12-bit immediate are not put in the literal table)
+code_seq gen_code_number(number_t num, unsigned int target){
+    if (TWELVEBITSMINSIGNED <= num.value && num.value <= TWELVEBITSMAXSIGNED) {
+        return code_seq_singleton(code_lit(SP, target, num.value));
+    }
     int offset = literal_table_lookup(num.text, num.value);
-    return code_seq_singleton(code_cpw(SP,0,GP,offset));
+    return code_seq_singleton(code_cpw(SP, target, GP, offset));
 }
 
-code_seq gen_code_negated_expr(negated_expr_t expr) {
-    code_seq ret = gen_code_expr(*expr.expr);
-    code_seq_add_to_end(&ret, code_neg(SP, 0, SP, 0));
+code_seq gen_code_negated_expr(negated_expr_t expr, unsigned int target, unsigned int first_free) {
+    code_seq ret = gen_code_expr(*expr.expr, target, first_free);
+    code_seq_add_to_end(&ret, code_neg(SP, target, SP, target));
     return ret;
 }
-
@@ -16,6 +16,10 @@
 #include "utilities.h"
 #include "regname.h"
 #include "code_utils.h"
+#include "peephole.h"
+#include "arena.h"
+#include "loop_invariant.h"
+#include "cse.h"
 #include "spl.tab.h"
 #include "symtab.h"
 
@@ -30,24 +34,28 @@ extern void gen_code_program(BOFFILE bf, block_t prog);
 // Generate code for prog into bf
 extern void gen_code_program(BOFFILE bf, block_t prog);
 
+// Turn the code generator's optimizations (strength reduction,
+// loop-invariant hoisting and common subexpression reuse) on or off
+// (they are on by default)
+extern void gen_code_set_optimizing(bool on);
+
+// Generate code for the block blk
+extern code_seq gen_code_block(block_t blk);
+
 // Generate code for the var_decls_t vds to out
-// There are 2 instructions generated for each identifier declared
-// (one to allocate space and another to initialize that space)
+// (each variable is given a word in the data section, and a LIT
+// sets it to 0 each time the block is entered)
 extern code_seq gen_code_var_decls(var_decls_t vds);
 
 extern code_seq gen_code_const_decls(const_decls_t cds);
 
-// Generate code for a single <var-decl>, vd,
-// There are 2 instructions generated for each identifier declared
-// (one to allocate space and another to initialize that space)
+// Generate code for a single <var-decl>, vd
 extern code_seq gen_code_var_decl(var_decl_t vd);
 
 extern code_seq gen_code_const_decl(const_decl_t cd);
 
-// Generate code for the identififers in idents with type t
-// in reverse order (so the first declared are allocated last).
-// There are 2 instructions generated for each identifier declared
-// (one to allocate space and another to initialize that space)
+// Generate code for the identififers in idents,
+// giving each a word in the data section (in order)
 extern code_seq gen_code_idents(ident_list_t idents);
 
 extern code_seq gen_code_const_defs(const_def_list_t cds);
@@ -80,20 +88,55 @@ extern code_seq gen_code_read_stmt(read_stmt_t stmt);
 // Generate code for the write statment given by stmt.
 extern code_seq gen_code_print_stmt(print_stmt_t stmt);
 
+// Conditions are generated as jumping code: code that evaluates
+// what a condition compares, followed by a branch on the comparison
+// (no boolean value is computed).
+
+// Generate code that evaluates what the branch for cond compares
+// (see gen_code_condition_branch)
 extern code_seq gen_code_condition(condition_t cond);
 
+// Requires: the code from gen_code_condition(cond) was just executed.
+// Return a branch to offset instructions from it,
+// which is taken just when the value of cond is jump_when
+extern code *gen_code_condition_branch(condition_t cond, bool jump_when,
+                                       int offset);
+
+// Generate code that puts expr1 in temporary 0 and expr2 in the first
+// scratch temporary, unless a temporary holds it (for == and !=),
+// or expr1 - expr2 in temporary 0 (for the other operators)
 extern code_seq gen_code_rel_op_condition(rel_op_condition_t cond);
 
+// Generate code that puts the remainder of dividend / divisor
+// in temporary 0 and 0 in the first scratch temporary
+// (or, if the divisor is a small power of 2, the bits of the dividend
+// that must be 0 for it to be divisible in temporary 0)
 extern code_seq gen_code_db_condition(db_condition_t cond);
 
-extern code_seq gen_code_expr(expr_t expr);
-
-extern code_seq gen_code_binary_op_expr(binary_op_expr_t bin);
-
-extern code_seq gen_code_ident(ident_t ident);
-
-extern code_seq gen_code_number(number_t num);
-
-extern code_seq gen_code_negated_expr(negated_expr_t expr);
+// Expressions are evaluated into temporaries: words at fixed offsets
+// from SP, which each block reserves once in its frame
+// (so SP does not change while a statement runs).
+// In a while loop, the temporaries after temporary 0 hold the values
+// of its loop-invariant expressions (see loop_invariant.h),
+// which are copied from them instead of being evaluated again;
+// the same is done for the common subexpressions in runs of
+// straight-line statements (see cse.h).
+// Generate code that puts the value of expr in the temporary at offset
+// target, using temporary 0 and the temporaries at offsets first_free
+// and above as scratch space
+extern code_seq gen_code_expr(expr_t expr, unsigned int target,
+                              unsigned int first_free);
+
+extern code_seq gen_code_binary_op_expr(binary_op_expr_t bin,
+                                        unsigned int target,
+                                        unsigned int first_free);
+
+extern code_seq gen_code_ident(ident_t ident, unsigned int target);
+
+extern code_seq gen_code_number(number_t num, unsigned int target);
+
+extern code_seq gen_code_negated_expr(negated_expr_t expr,
+                                      unsigned int target,
+                                      unsigned int first_free);
 
 #endif
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include "utilities.h"
 #include "id_attrs.h"
+#include "arena.h"
 
 // Return a freshly allocated id_attrs struct
 // with its field file_loc set to floc, kind set to k, 
@@ -13,10 +14,7 @@
 id_attrs *id_attrs_create(file_location floc, id_kind k,
 				 unsigned int ofst_cnt)
 {
-    id_attrs *ret = (id_attrs *)malloc(sizeof(id_attrs));
-    if (ret == NULL) {
-	bail_with_error("No space to allocate id_attrs!");
-    }
+    id_attrs *ret = (id_attrs *)arena_alloc(sizeof(id_attrs));
     ret->file_loc = floc;
     ret->kind = k;
     ret->offset_count = ofst_cnt;
@@ -29,10 +27,7 @@ id_attrs *id_attrs_create(file_location floc, id_kind k,
 // so this should never return NULL.
 extern id_attrs *id_attrs_proc_create(file_location floc)
 {
-    id_attrs *ret = (id_attrs *)malloc(sizeof(id_attrs));
-    if (ret == NULL) {
-	bail_with_error("No space to allocate id_attrs!");
-    }
+    id_attrs *ret = (id_attrs *)arena_alloc(sizeof(id_attrs));
     ret->file_loc = floc;
     ret->kind = procedure_idk;
     return ret;
@@ -3,6 +3,7 @@
 #include "machine_types.h"
 #include "id_use.h"
 #include "utilities.h"
+#include "arena.h"
 
 // Requires: attrs != NULL
 // Return a (pointer to a fresh) id_use struct containing the attributes
@@ -12,10 +13,7 @@
 // so this should never return NULL.
 extern id_use *id_use_create(id_attrs *attrs, unsigned int levelsOut)
 {
-    id_use *ret = (id_use *)malloc(sizeof(id_use));
-    if (ret == NULL) {
-	bail_with_error("No space to allocate id_use!");
-    }
+    id_use *ret = (id_use *)arena_alloc(sizeof(id_use));
     ret->attrs = attrs;
     ret->levelsOutward = levelsOut;
     // Shouldn't create a label for procedures here!
@@ -37,10 +35,7 @@ id_attrs *id_use_get_attrs(id_use *idu)
 // Return (a pointer to) the lexical address for idu.
 lexical_address *id_use_2_lexical_address(id_use *idu)
 {
-    lexical_address *ret = (lexical_address *)malloc(sizeof(lexical_address));
-    if (ret == NULL) {
-	bail_with_error("No space to allocate lexical_address!");
-    }
+    lexical_address *ret = (lexical_address *)arena_alloc(sizeof(lexical_address));
     ret->levelsOutward = idu->levelsOutward;
     ret->offsetInAR = idu->attrs->offset_count;
     return ret;
@@ -62,6 +62,30 @@ void literal_table_initialize()
     literal_table_okay();
 }
 
+// Add an entry for text/value at the end of the table
+// and return its word offset
+static unsigned int literal_table_add(const char *text, word_type value)
+{
+    literal_table_entry_t *new_entry
+	= (literal_table_entry_t *)malloc(sizeof(literal_table_entry_t));
+    if (new_entry == NULL) {
+	bail_with_error("No space to allocate new literal table entry!");
+    }
+    new_entry->text = text;
+    new_entry->value = value;
+    new_entry->next = NULL;
+    new_entry->offset = next_word_offset++;
+    if (first == NULL) {
+	first = new_entry;
+	last = new_entry;
+    } else {
+	last->next = new_entry;
+	last = new_entry;
+    }
+    literal_table_okay();
+    return new_entry->offset;
+}
+
 // Requires: sought is the print form of value
 // return the offset of sought/value if it is in the table
 // otherwise return -1.
@@ -70,7 +94,8 @@ int literal_table_find_offset(const char *sought, word_type value)
     literal_table_okay();
     literal_table_entry_t *entry = first;
     while (entry != NULL) {
-	if (strcmp(entry->text, sought) == 0) {
+	// (reserved words have no text, so they are never found)
+	if (entry->text != NULL && strcmp(entry->text, sought) == 0) {
 	    return entry->offset;
 	}
 	entry = entry->next;
@@ -97,25 +122,14 @@ unsigned int literal_table_lookup(const char *val_string,
 	return ret;
     }
     // it's not already present, so insert it
-    literal_table_entry_t *new_entry
-	= (literal_table_entry_t *)malloc(sizeof(literal_table_entry_t));
-    new_entry->text = val_string;
-    new_entry->value = value;
-    new_entry->next = NULL;
-    ret = next_word_offset;
-    new_entry->offset = next_word_offset++;
-    if (new_entry == NULL) {
-	bail_with_error("No space to allocate new literal table entry!");
-    }
-    if (first == NULL) {
-	first = new_entry;
-	last = new_entry;
-    } else {
-	last->next = new_entry;
-	last = new_entry;
-    }
-    literal_table_okay();
-    return ret;
+    return literal_table_add(val_string, value);
+}
+
+// Return the word offset of a new entry with value 0,
+// which is never shared with a literal (so it can hold a variable)
+unsigned int literal_table_reserve_word()
+{
+    return literal_table_add(NULL, 0);
 }
 
 // === iteration helpers ===
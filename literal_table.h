@@ -27,6 +27,10 @@ extern bool literal_table_present(const char *sought, word_type value);
 extern unsigned int literal_table_lookup(const char *val_string,
 					 word_type value);
 
+// Return the word offset of a new entry with value 0,
+// which is never shared with a literal (so it can hold a variable)
+extern unsigned int literal_table_reserve_word();
+
 // === iteration helpers ===
 
 // Start an iteration over the literal table
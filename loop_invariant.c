@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include "ast.h"
+#include "id_use.h"
+#include "id_attrs.h"
+#include "spl.tab.h"
+#include "utilities.h"
+#include "loop_invariant.h"
+
+// The variables assigned (or read into) in the loop being analyzed
+static id_attrs **assigned = NULL;
+static unsigned int assigned_count = 0;
+static unsigned int assigned_size = 0;
+// does the loop call a procedure (which may assign any variable)?
+static bool has_call = false;
+
+// The loop-invariant expressions found so far
+static expr_t **found;
+static unsigned int found_count;
+static unsigned int found_max;
+
+// Add the variable used by idu to the assigned variables
+static void add_assigned(id_use *idu)
+{
+    if (assigned_count == assigned_size) {
+	assigned_size = (assigned_size == 0) ? 16 : 2 * assigned_size;
+	assigned = realloc(assigned, assigned_size * sizeof(id_attrs *));
+	if (assigned == NULL) {
+	    bail_with_error("No space to record the variables of a loop!");
+	}
+    }
+    assigned[assigned_count++] = id_use_get_attrs(idu);
+}
+
+// Add the variables assigned (or read into) in stmts,
+// including those in nested statements and blocks
+static void find_assigned_stmts(stmts_t *stmts)
+{
+    if (stmts->stmts_kind == empty_stmts_e) {
+	return;
+    }
+    for (stmt_t *sp = stmts->stmt_list.start; sp != NULL; sp = sp->next) {
+	switch (sp->stmt_kind) {
+	case assign_stmt:
+	    add_assigned(sp->data.assign_stmt.idu);
+	    break;
+	case read_stmt:
+	    add_assigned(sp->data.read_stmt.idu);
+	    break;
+	case call_stmt:
+	    has_call = true;
+	    break;
+	case if_stmt:
+	    find_assigned_stmts(sp->data.if_stmt.then_stmts);
+	    if (sp->data.if_stmt.else_stmts != NULL) {
+		find_assigned_stmts(sp->data.if_stmt.else_stmts);
+	    }
+	    break;
+	case while_stmt:
+	    find_assigned_stmts(sp->data.while_stmt.body);
+	    break;
+	case block_stmt:
+	    find_assigned_stmts(&(sp->data.block_stmt.block->stmts));
+	    break;
+	default: // print statements do not assign
+	    break;
+	}
+    }
+}
+
+// Is the identifier used by idu a constant or a variable
+// that is not assigned in the loop?
+static bool is_invariant_ident(id_use *idu)
+{
+    id_attrs *attrs = id_use_get_attrs(idu);
+    if (attrs->kind == constant_idk) {
+	return true;
+    }
+    if (has_call) {
+	return false;
+    }
+    for (unsigned int i = 0; i < assigned_count; i++) {
+	if (assigned[i] == attrs) {
+	    return false;
+	}
+    }
+    return true;
+}
+
+// Is the value of exp the same each time it is evaluated in the loop?
+static bool is_invariant(expr_t exp)
+{
+    switch (exp.expr_kind) {
+    case expr_bin:
+	return is_invariant(*(exp.data.binary.expr1))
+	    && is_invariant(*(exp.data.binary.expr2));
+    case expr_negated:
+	return is_invariant(*(exp.data.negated.expr));
+    case expr_ident:
+	return is_invariant_ident(exp.data.ident.idu);
+    default: // numbers
+	return true;
+    }
+}
+
+// Does exp divide by something that is not a number other than 0 or -1?
+// (dividing the most negative word by -1 overflows, which traps
+// on most machines)
+static bool may_trap(expr_t exp)
+{
+    switch (exp.expr_kind) {
+    case expr_bin:
+	if (exp.data.binary.arith_op.code == divsym) {
+	    expr_t *divisor = exp.data.binary.expr2;
+	    if (divisor->expr_kind != expr_number
+		|| divisor->data.number.value == 0
+		|| divisor->data.number.value == -1) {
+		return true;
+	    }
+	}
+	return may_trap(*(exp.data.binary.expr1))
+	    || may_trap(*(exp.data.binary.expr2));
+    case expr_negated:
+	return may_trap(*(exp.data.negated.expr));
+    default:
+	return false;
+    }
+}
+
+// Add the largest loop-invariant subexpressions of *exp to found
+static void find_invariant_expr(expr_t *exp)
+{
+    if (found_count == found_max) {
+	return;
+    }
+    if (is_invariant(*exp) && !may_trap(*exp)) {
+	if (exp->expr_kind == expr_ident || exp->expr_kind == expr_number) {
+	    return;
+	}
+	for (unsigned int i = 0; i < found_count; i++) {
+	    if (ast_expr_equal(*(found[i]), *exp)) {
+		return;
+	    }
+	}
+	found[found_count++] = exp;
+	return;
+    }
+    switch (exp->expr_kind) {
+    case expr_bin:
+	find_invariant_expr(exp->data.binary.expr1);
+	find_invariant_expr(exp->data.binary.expr2);
+	break;
+    case expr_negated:
+	find_invariant_expr(exp->data.negated.expr);
+	break;
+    default:
+	break;
+    }
+}
+
+// Add the largest loop-invariant subexpressions of *cond to found
+static void find_invariant_condition(condition_t *cond)
+{
+    if (cond->cond_kind == ck_db) {
+	find_invariant_expr(&(cond->data.db_cond.dividend));
+	find_invariant_expr(&(cond->data.db_cond.divisor));
+    } else {
+	find_invariant_expr(&(cond->data.rel_op_cond.expr1));
+	find_invariant_expr(&(cond->data.rel_op_cond.expr2));
+    }
+}
+
+// Add the largest loop-invariant subexpressions of the expressions
+// in stmts (but not those in nested blocks) to found
+static void find_invariant_stmts(stmts_t *stmts)
+{
+    if (stmts->stmts_kind == empty_stmts_e) {
+	return;
+    }
+    for (stmt_t *sp = stmts->stmt_list.start; sp != NULL; sp = sp->next) {
+	switch (sp->stmt_kind) {
+	case assign_stmt:
+	    find_invariant_expr(sp->data.assign_stmt.expr);
+	    break;
+	case print_stmt:
+	    find_invariant_expr(&(sp->data.print_stmt.expr));
+	    break;
+	case if_stmt:
+	    find_invariant_condition(&(sp->data.if_stmt.condition));
+	    find_invariant_stmts(sp->data.if_stmt.then_stmts);
+	    if (sp->data.if_stmt.else_stmts != NULL) {
+		find_invariant_stmts(sp->data.if_stmt.else_stmts);
+	    }
+	    break;
+	case while_stmt:
+	    find_invariant_condition(&(sp->data.while_stmt.condition));
+	    find_invariant_stmts(sp->data.while_stmt.body);
+	    break;
+	default: // read, call, and block statements
+	    break;
+	}
+    }
+}
+
+// Requires: loop has been scope checked.
+// Put in exprs (up to max of them) the largest loop-invariant
+// subexpressions of loop's condition and of the expressions
+// in loop's body (except those in nested blocks, which have
+// their own declarations), leaving out plain identifiers and numbers,
+// expressions that are the same as one already put in exprs,
+// and expressions that divide by something that may be 0 or -1
+// (as they may stop the program, they must only be evaluated where
+// they occur). Return the number of expressions put in exprs.
+unsigned int loop_invariant_exprs(while_stmt_t *loop,
+				  expr_t **exprs, unsigned int max)
+{
+    assigned_count = 0;
+    has_call = false;
+    find_assigned_stmts(loop->body);
+
+    found = exprs;
+    found_count = 0;
+    found_max = max;
+    find_invariant_condition(&(loop->condition));
+    find_invariant_stmts(loop->body);
+    return found_count;
+}
@@ -0,0 +1,22 @@
+#ifndef _LOOP_INVARIANT_H
+#define _LOOP_INVARIANT_H
+#include "ast.h"
+
+// Finding the loop-invariant expressions of while loops:
+// arithmetic expressions whose value is the same each time
+// they are evaluated in the loop, because none of the variables
+// they use is assigned (or read into) anywhere in the loop.
+
+// Requires: loop has been scope checked.
+// Put in exprs (up to max of them) the largest loop-invariant
+// subexpressions of loop's condition and of the expressions
+// in loop's body (except those in nested blocks, which have
+// their own declarations), leaving out plain identifiers and numbers,
+// expressions that are the same as one already put in exprs,
+// and expressions that divide by something that may be 0 or -1
+// (as they may stop the program, they must only be evaluated where
+// they occur). Return the number of expressions put in exprs.
+extern unsigned int loop_invariant_exprs(while_stmt_t *loop,
+					 expr_t **exprs, unsigned int max);
+
+#endif
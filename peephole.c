@@ -0,0 +1,549 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include "machine_types.h"
+#include "instruction.h"
+#include "regname.h"
+#include "utilities.h"
+#include "peephole.h"
+
+// the most unconditional jumps followed to find where a branch goes
+// (more than that is taken to be a loop of jumps)
+#define MAX_JUMP_CHAIN 16
+
+// the rules in use
+static unsigned int rules = PEEPHOLE_ALL_RULES;
+
+// The program being optimized, as an array of its instructions.
+// A relative branch or jump is represented by the index of its target,
+// which may be num_instrs (for a jump past the last instruction);
+// its offset is only recomputed when the code is put back in order.
+static code **instrs;
+static int num_instrs;
+// has the instruction at each index been removed?
+static bool *deleted;
+// the index of the target of the branch at each index (or -1)
+static int *target;
+// the number of (not removed) branches to each index
+static int *num_jumps_to;
+
+// Use only the rules given by the flags in rules
+// in later calls to peephole_optimize (0 turns the optimizer off)
+void peephole_set_rules(unsigned int r)
+{
+    rules = r;
+}
+
+// Is bi a relative branch or jump (whose target is known)?
+static bool is_relative_branch(bin_instr_t bi)
+{
+    switch (instruction_type(bi)) {
+    case immed_instr_type:
+	switch (bi.immed.op) {
+	case BEQ_O: case BGEZ_O: case BGTZ_O: case BLEZ_O: case BLTZ_O:
+	case BNE_O:
+	    return true;
+	default:
+	    return false;
+	}
+    case other_comp_instr_type:
+	return bi.othc.func == JREL_F;
+    default:
+	return false;
+    }
+}
+
+// Does bi transfer control to somewhere that is not known
+// (an absolute address or an address in a register)?
+static bool is_unknown_jump(bin_instr_t bi)
+{
+    switch (instruction_type(bi)) {
+    case jump_instr_type:
+	return true;
+    case other_comp_instr_type:
+	return bi.othc.func == JMP_F || bi.othc.func == CSI_F;
+    default:
+	return false;
+    }
+}
+
+// Requires: is_relative_branch(bi)
+// Return the offset of the branch bi
+static int branch_offset(bin_instr_t bi)
+{
+    if (instruction_type(bi) == other_comp_instr_type) {
+	return bi.othc.arg;
+    }
+    return bi.immed.immed;
+}
+
+// Requires: is_relative_branch(bi)
+// Can the branch bi have the offset offset?
+static bool branch_offset_fits(bin_instr_t bi, int offset)
+{
+    if (instruction_type(bi) == other_comp_instr_type) {
+	return TWELVEBITSMINSIGNED <= offset && offset <= TWELVEBITSMAXSIGNED;
+    }
+    return SHRT_MIN <= offset && offset <= SHRT_MAX;
+}
+
+// Requires: is_relative_branch(*bi) and branch_offset_fits(*bi, offset)
+// Make offset the offset of the branch *bi
+static void set_branch_offset(bin_instr_t *bi, int offset)
+{
+    if (instruction_type(*bi) == other_comp_instr_type) {
+	bi->othc.arg = offset;
+    } else {
+	bi->immed.immed = offset;
+    }
+}
+
+// Does bi always branch?
+// (A BEQ comparing the top of the stack with itself always does.)
+static bool is_unconditional_jump(bin_instr_t bi)
+{
+    switch (instruction_type(bi)) {
+    case other_comp_instr_type:
+	return bi.othc.func == JREL_F;
+    case immed_instr_type:
+	return bi.immed.op == BEQ_O && bi.immed.reg == SP
+	    && bi.immed.offset == 0;
+    default:
+	return false;
+    }
+}
+
+// Does bi never branch (a BNE comparing the top of the stack with itself)?
+static bool never_branches(bin_instr_t bi)
+{
+    return instruction_type(bi) == immed_instr_type
+	&& bi.immed.op == BNE_O && bi.immed.reg == SP && bi.immed.offset == 0;
+}
+
+// Is bi an EXIT instruction?
+static bool is_exit(bin_instr_t bi)
+{
+    return instruction_type(bi) == syscall_instr_type
+	&& bi.syscall.code == exit_sc;
+}
+
+// If bi is a conditional branch, set *inv to the branch
+// with the opposite condition (and the same operands) and return true;
+// otherwise return false
+static bool inverse_branch(bin_instr_t bi, bin_instr_t *inv)
+{
+    if (instruction_type(bi) != immed_instr_type || is_unconditional_jump(bi)
+	|| never_branches(bi)) {
+	return false;
+    }
+    *inv = bi;
+    switch (bi.immed.op) {
+    case BEQ_O:
+	inv->immed.op = BNE_O;
+	return true;
+    case BNE_O:
+	inv->immed.op = BEQ_O;
+	return true;
+    case BGEZ_O:
+	inv->immed.op = BLTZ_O;
+	return true;
+    case BLTZ_O:
+	inv->immed.op = BGEZ_O;
+	return true;
+    case BGTZ_O:
+	inv->immed.op = BLEZ_O;
+	return true;
+    case BLEZ_O:
+	inv->immed.op = BGTZ_O;
+	return true;
+    default:
+	return false;
+    }
+}
+
+// If bi adds to or subtracts from $sp (with ARI or SRI),
+// set *amount to the amount added to $sp and return true;
+// otherwise return false
+static bool stack_adjustment(bin_instr_t bi, int *amount)
+{
+    if (instruction_type(bi) != other_comp_instr_type || bi.othc.reg != SP) {
+	return false;
+    }
+    if (bi.othc.func == ARI_F) {
+	*amount = bi.othc.arg;
+	return true;
+    } else if (bi.othc.func == SRI_F) {
+	*amount = - bi.othc.arg;
+	return true;
+    }
+    return false;
+}
+
+// Requires: amount != 0, and amount fits in 12 bits (signed)
+// Make *bi an instruction that adds amount to $sp
+static void set_stack_adjustment(bin_instr_t *bi, int amount)
+{
+    bi->othc.op = OTHC_O;
+    bi->othc.reg = SP;
+    bi->othc.offset = 0;
+    bi->othc.func = (amount > 0) ? ARI_F : SRI_F;
+    bi->othc.arg = (amount > 0) ? amount : - amount;
+}
+
+// Does bi set $sp to a value that does not depend on $sp?
+static bool overwrites_sp(bin_instr_t bi)
+{
+    return instruction_type(bi) == comp_instr_type
+	&& (bi.comp.func == CPR_F || bi.comp.func == LWR_F)
+	&& bi.comp.rt == SP && bi.comp.rs != SP;
+}
+
+// If the only effect of bi is to write the word at $sp plus some offset,
+// set *offset to that offset and return true; otherwise return false
+static bool writes_stack_word(bin_instr_t bi, int *offset)
+{
+    switch (instruction_type(bi)) {
+    case comp_instr_type:
+	switch (bi.comp.func) {
+	case ADD_F: case SUB_F: case CPW_F: case AND_F: case BOR_F:
+	case NOR_F: case XOR_F: case SWR_F: case SCA_F: case LWI_F: case NEG_F:
+	    if (bi.comp.rt == SP) {
+		*offset = bi.comp.ot;
+		return true;
+	    }
+	    return false;
+	default:
+	    return false;
+	}
+    case other_comp_instr_type:
+	switch (bi.othc.func) {
+	case LIT_F: case CFHI_F: case CFLO_F:
+	    if (bi.othc.reg == SP) {
+		*offset = bi.othc.offset;
+		return true;
+	    }
+	    return false;
+	default:
+	    return false;
+	}
+    default:
+	return false;
+    }
+}
+
+// Could the word at address GPR[reg] + offset be the one at $sp plus k?
+// (Words addressed from $gp are in the data section, below the stack.)
+static bool may_be_stack_word(reg_num_type reg, int offset, int k)
+{
+    if (reg == SP) {
+	return offset == k;
+    }
+    return reg != GP;
+}
+
+// Requires: writes_stack_word(bi, &offset) for some offset
+// Could the value that bi writes depend on the word at $sp plus k?
+static bool may_read_stack_word(bin_instr_t bi, int k)
+{
+    if (instruction_type(bi) != comp_instr_type) {
+	return false;
+    }
+    comp_instr_t ci = bi.comp;
+    switch (ci.func) {
+    case SUB_F: case XOR_F:
+	// the top of the stack minus (or xor) itself is 0, whatever it is
+	if (ci.rs == SP && ci.os == 0) {
+	    return false;
+	}
+	// otherwise these read the top of the stack, as do the following
+    case ADD_F: case AND_F: case BOR_F: case NOR_F:
+	return k == 0 || may_be_stack_word(ci.rs, ci.os, k);
+    case CPW_F: case NEG_F:
+	return may_be_stack_word(ci.rs, ci.os, k);
+    case LWI_F:
+	return true;
+    default:
+	return false;
+    }
+}
+
+// Return the index of the first instruction at or after i
+// that has not been removed (or num_instrs if there is none)
+static int next_live(int i)
+{
+    while (i < num_instrs && deleted[i]) {
+	i++;
+    }
+    return i;
+}
+
+// Remove the instruction at index i
+static void remove_instr(int i)
+{
+    deleted[i] = true;
+}
+
+// Make the branch at index i go to index t instead
+static void retarget(int i, int t)
+{
+    num_jumps_to[target[i]]--;
+    target[i] = next_live(t);
+    num_jumps_to[target[i]]++;
+}
+
+// Return the index that control goes to from index t,
+// following unconditional jumps (or -1 if they seem to loop forever)
+static int jump_destination(int t)
+{
+    for (int hops = 0; hops <= MAX_JUMP_CHAIN; hops++) {
+	t = next_live(t);
+	if (t >= num_instrs || !is_unconditional_jump(instrs[t]->instr)) {
+	    return t;
+	}
+	t = target[t];
+    }
+    return -1;
+}
+
+// Apply the branch rules to the branch at index i,
+// whose next instruction is at index j.
+// Return true if something was changed.
+static bool rewrite_branch(int i, int j)
+{
+    bin_instr_t *bi = &(instrs[i]->instr);
+    if (target[i] == j || never_branches(*bi)) {
+	// it goes to the next instruction either way
+	remove_instr(i);
+	return true;
+    }
+    int dest = jump_destination(target[i]);
+    if (dest >= 0 && dest != target[i] && branch_offset_fits(*bi, dest - i)) {
+	// branch straight to where the jumps go
+	retarget(i, dest);
+	return true;
+    }
+    bin_instr_t inv;
+    if (j < num_instrs && num_jumps_to[j] == 0
+	&& is_unconditional_jump(instrs[j]->instr)
+	&& target[i] == next_live(j + 1)
+	&& inverse_branch(*bi, &inv)
+	&& branch_offset_fits(inv, target[j] - i)) {
+	// branching over a jump is branching to its target on the opposite
+	*bi = inv;
+	retarget(i, target[j]);
+	remove_instr(j);
+	return true;
+    }
+    return false;
+}
+
+// Remove the instructions after index i that cannot be reached
+// (because the instruction at i always jumps or exits).
+// Return true if something was removed.
+static bool remove_unreachable(int i)
+{
+    bool changed = false;
+    for (int k = next_live(i + 1); k < num_instrs && num_jumps_to[k] == 0;
+	 k = next_live(k + 1)) {
+	remove_instr(k);
+	changed = true;
+    }
+    return changed;
+}
+
+// Apply the stack adjustment rules to the instruction at index i,
+// which adds amount to $sp, and whose next instruction is at index j.
+// Return true if something was changed.
+static bool rewrite_stack_adjustment(int i, int amount, int j)
+{
+    if (amount == 0) {
+	remove_instr(i);
+	return true;
+    }
+    if (j >= num_instrs) {
+	return false;
+    }
+    bin_instr_t next = instrs[j]->instr;
+    int next_amount;
+    if (num_jumps_to[j] == 0 && stack_adjustment(next, &next_amount)
+	&& TWELVEBITSMINSIGNED <= amount + next_amount
+	&& amount + next_amount <= TWELVEBITSMAXSIGNED) {
+	if (amount + next_amount == 0) {
+	    remove_instr(i);
+	} else {
+	    set_stack_adjustment(&(instrs[i]->instr), amount + next_amount);
+	}
+	remove_instr(j);
+	return true;
+    }
+    if (overwrites_sp(next)) {
+	remove_instr(i);
+	return true;
+    }
+    return false;
+}
+
+// Apply the dead store rules to the instruction at index i,
+// which only writes the word at $sp plus offset,
+// and whose next instruction is at index j.
+// Return true if something was changed.
+// (The words below the top of the stack are taken to be dead.)
+static bool rewrite_stack_store(int i, int offset, int j)
+{
+    if (j >= num_instrs) {
+	return false;
+    }
+    bin_instr_t next = instrs[j]->instr;
+    int next_offset;
+    int amount;
+    if ((writes_stack_word(next, &next_offset) && next_offset == offset
+	 && !may_read_stack_word(next, offset))
+	|| (stack_adjustment(next, &amount) && 0 <= offset && offset < amount)) {
+	remove_instr(i);
+	return true;
+    }
+    return false;
+}
+
+// Apply the rules to the instruction at index i,
+// returning true if anything was changed
+static bool rewrite_at(int i)
+{
+    int j = next_live(i + 1);
+    bin_instr_t bi = instrs[i]->instr;
+    int n;
+    if (rules & PEEPHOLE_BRANCHES) {
+	if (target[i] >= 0 && rewrite_branch(i, j)) {
+	    return true;
+	}
+	if ((is_unconditional_jump(bi) || is_exit(bi))
+	    && remove_unreachable(i)) {
+	    return true;
+	}
+    }
+    if ((rules & PEEPHOLE_STACK_ADJUSTMENTS) && stack_adjustment(bi, &n)
+	&& rewrite_stack_adjustment(i, n, j)) {
+	return true;
+    }
+    return (rules & PEEPHOLE_DEAD_STORES) && writes_stack_word(bi, &n)
+	&& rewrite_stack_store(i, n, j);
+}
+
+// Apply the rules to each instruction (and again where something
+// changed, since one rewrite can make another possible),
+// returning true if anything was changed
+static bool peephole_pass()
+{
+    // branches to removed instructions go to the next remaining one
+    for (int i = 0; i <= num_instrs; i++) {
+	num_jumps_to[i] = 0;
+    }
+    for (int i = next_live(0); i < num_instrs; i = next_live(i + 1)) {
+	if (target[i] >= 0) {
+	    target[i] = next_live(target[i]);
+	    num_jumps_to[target[i]]++;
+	}
+    }
+    bool changed = false;
+    int prev = -1;  // the instruction before i (if known)
+    int i = next_live(0);
+    while (i < num_instrs) {
+	if (rewrite_at(i)) {
+	    changed = true;
+	    if (deleted[i] && prev >= 0) {
+		// the instruction before it has a new next one
+		i = prev;
+		prev = -1;
+	    }
+	    i = next_live(i);
+	} else {
+	    prev = i;
+	    i = next_live(i + 1);
+	}
+    }
+    return changed;
+}
+
+// Put the remaining instructions back in a code_seq,
+// recomputing the branches' offsets
+static code_seq peephole_result()
+{
+    // the new index of each instruction (and of the end)
+    int *new_index = (int *) malloc((num_instrs + 1) * sizeof(int));
+    if (new_index == NULL) {
+	bail_with_error("No space to optimize the code!");
+    }
+    int count = 0;
+    for (int i = 0; i < num_instrs; i++) {
+	new_index[i] = count;
+	if (!deleted[i]) {
+	    count++;
+	}
+    }
+    new_index[num_instrs] = count;
+    code_seq ret = code_seq_empty();
+    for (int i = 0; i < num_instrs; i++) {
+	if (deleted[i]) {
+	    continue;
+	}
+	if (target[i] >= 0) {
+	    // offsets only get smaller, so the new one fits
+	    set_branch_offset(&(instrs[i]->instr),
+			      new_index[next_live(target[i])] - new_index[i]);
+	}
+	instrs[i]->next = NULL;
+	code_seq_add_to_end(&ret, instrs[i]);
+    }
+    free(new_index);
+    return ret;
+}
+
+// Return a code sequence with the same effect as cs, improved using
+// the current rules (cs's code structs are reused, so cs should not
+// be used afterwards).
+// Code with absolute jumps, calls, or jumps through registers
+// is returned unchanged.
+code_seq peephole_optimize(code_seq cs)
+{
+    if (rules == 0) {
+	return cs;
+    }
+    num_instrs = code_seq_size(cs);
+    instrs = (code **) malloc(num_instrs * sizeof(code *));
+    deleted = (bool *) calloc(num_instrs, sizeof(bool));
+    target = (int *) malloc(num_instrs * sizeof(int));
+    num_jumps_to = (int *) malloc((num_instrs + 1) * sizeof(int));
+    if (num_instrs > 0
+	&& (instrs == NULL || deleted == NULL || target == NULL
+	    || num_jumps_to == NULL)) {
+	bail_with_error("No space to optimize the code!");
+    }
+    bool optimizable = true;
+    code_seq rest = cs;
+    for (int i = 0; i < num_instrs; i++) {
+	instrs[i] = code_seq_first(rest);
+	rest = code_seq_rest(rest);
+	bin_instr_t bi = instrs[i]->instr;
+	target[i] = -1;
+	if (is_unknown_jump(bi)) {
+	    optimizable = false;
+	} else if (is_relative_branch(bi)) {
+	    target[i] = i + branch_offset(bi);
+	    if (target[i] < 0 || num_instrs < target[i]) {
+		optimizable = false;
+	    }
+	}
+    }
+    code_seq ret = cs;
+    if (optimizable) {
+	while (peephole_pass()) {
+	    ;
+	}
+	ret = peephole_result();
+    }
+    free(instrs);
+    free(deleted);
+    free(target);
+    free(num_jumps_to);
+    return ret;
+}
@@ -0,0 +1,36 @@
+#ifndef _PEEPHOLE_H
+#define _PEEPHOLE_H
+#include "code_seq.h"
+
+// A peephole optimizer for the code generated for a program.
+// It looks at windows of consecutive instructions and replaces them
+// with shorter code (or none) that has the same effect,
+// then recomputes the offsets of the relative branches and jumps.
+// The rules it uses can be chosen (by or-ing the following flags):
+
+// merge adjacent ARI and SRI instructions on $sp (removing ones
+// that cancel out), and remove ones whose result is overwritten
+#define PEEPHOLE_STACK_ADJUSTMENTS 0x1
+// remove writes to words on the stack that are overwritten
+// (without being read) or popped off the stack by the next instruction
+#define PEEPHOLE_DEAD_STORES 0x2
+// remove branches to the next instruction and unreachable code,
+// make branches to unconditional jumps go to their targets, and turn
+// a conditional branch over an unconditional jump into one branch
+#define PEEPHOLE_BRANCHES 0x4
+// all of the rules (the default)
+#define PEEPHOLE_ALL_RULES \
+    (PEEPHOLE_STACK_ADJUSTMENTS | PEEPHOLE_DEAD_STORES | PEEPHOLE_BRANCHES)
+
+// Use only the rules given by the flags in rules
+// in later calls to peephole_optimize (0 turns the optimizer off)
+extern void peephole_set_rules(unsigned int rules);
+
+// Return a code sequence with the same effect as cs, improved using
+// the current rules (cs's code structs are reused, so cs should not
+// be used afterwards).
+// Code with absolute jumps, calls, or jumps through registers
+// is returned unchanged.
+extern code_seq peephole_optimize(code_seq cs);
+
+#endif
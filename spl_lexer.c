@@ -573,8 +573,8 @@ extern FILE *yyin;
 
 #undef yywrap   /* sometimes a macro by default */
 
-// apparently strdup is not declared in <string.h>
-extern char *strdup(const char *s);
+// token text is allocated in the compiler's arena
+#include "arena.h"
 
 // set the lexer's value for a token in yylval as an AST
 static void tok2ast(int code) {
@@ -582,7 +582,7 @@ static void tok2ast(int code) {
     t.token.file_loc = file_location_make(input_filename, yylineno);
     t.token.type_tag = token_ast;
     t.token.code = code;
-    t.token.text = strdup(yytext);
+    t.token.text = arena_strdup(yytext);
     yylval = t;
 }
 
@@ -591,7 +591,7 @@ static void ident2ast(const char *name) {
     assert(input_filename != NULL);
     t.ident.file_loc = file_location_make(input_filename, yylineno);
     t.ident.type_tag = ident_ast;
-    t.ident.name = strdup(name);
+    t.ident.name = arena_strdup(name);
     yylval = t;
 }
 
@@ -600,7 +600,7 @@ static void number2ast(unsigned int val)
     AST t;
     t.number.file_loc = file_location_make(input_filename, yylineno);
     t.number.type_tag = number_ast;
-    t.number.text = strdup(yytext);
+    t.number.text = arena_strdup(yytext);
     t.number.value = val;
     yylval = t;
 }
@@ -0,0 +1,684 @@
+// Ahead-of-time translation of binary object files into C programs.
+// Each instruction becomes a labeled C statement (a%d, where %d is
+// its address, as in the disassembler), branches and direct jumps
+// become gotos, and jumps to computed addresses go through a switch.
+// A small runtime for the system calls and the machine's invariant
+// is written into the same file, so the result is self-contained.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "bof2c.h"
+#include "bof.h"
+#include "instruction.h"
+#include "machine_types.h"
+#include "regname.h"
+#include "utilities.h"
+
+// the size of the VM's memory (as in machine.h)
+#define MEMORY_SIZE_IN_WORDS 32768
+
+// the runtime written into every translated program
+static const char *runtime_text[] = {
+    "#include <stdio.h>",
+    "#include <stdlib.h>",
+    "#include <stdarg.h>",
+    "#include <stdbool.h>",
+    "",
+    "#define MEMORY_SIZE_IN_WORDS 32768",
+    "#define GP 0",
+    "#define SP 1",
+    "#define FP 2",
+    "#define RA 7",
+    "#define LO 0",
+    "#define HI 1",
+    "typedef int word_type;",
+    "typedef unsigned int uword_type;",
+    "",
+    "static union {",
+    "    word_type words[MEMORY_SIZE_IN_WORDS];",
+    "    uword_type uwords[MEMORY_SIZE_IN_WORDS];",
+    "} memory;",
+    "static word_type GPR[8];",
+    "static union { long result; word_type hilo[2]; } hilo_regs;",
+    "static const char *progname;",
+    "#define W(a) memory.words[a]",
+    "#define U(a) memory.uwords[a]",
+    "",
+    "// Print an error message on stderr (after the program's output)",
+    "// and exit with a failure code",
+    "static void bail(const char *fmt, ...)",
+    "{",
+    "    va_list args;",
+    "    fflush(stdout);",
+    "    va_start(args, fmt);",
+    "    vfprintf(stderr, fmt, args);",
+    "    va_end(args);",
+    "    fprintf(stderr, \"\\n\");",
+    "    exit(EXIT_FAILURE);",
+    "}",
+    "",
+    "// Report that the machine's invariant (expr) failed, as the VM does",
+    "// (like a failed assertion, this does not flush stdout)",
+    "static void invariant_failed(const char *expr)",
+    "{",
+    "    fprintf(stderr, \"%s: machine_okay: Assertion `%s' failed.\\n\",",
+    "            progname, expr);",
+    "    abort();",
+    "}",
+    "",
+    "// Check the machine's invariant (after GP, SP, or FP change)",
+    "static void okay(void)",
+    "{",
+    "    if (!(0 <= GPR[GP])) invariant_failed(\"0 <= GPR[GP]\");",
+    "    if (!(GPR[GP] < GPR[SP])) invariant_failed(\"GPR[GP] < GPR[SP]\");",
+    "    if (!(GPR[SP] <= GPR[FP])) invariant_failed(\"GPR[SP] <= GPR[FP]\");",
+    "    if (!(GPR[FP] < MEMORY_SIZE_IN_WORDS))",
+    "        invariant_failed(\"GPR[FP] < MEMORY_SIZE_IN_WORDS\");",
+    "}",
+    "",
+    "// Return the address a of a word about to be stored,",
+    "// stopping if that would change the program's instructions",
+    "static inline word_type st(word_type a)",
+    "{",
+    "    if ((uword_type) a < TEXT_WORDS) {",
+    "        bail(\"The program changed its instruction at address %d;\"",
+    "             \" run it in the VM instead!\", a);",
+    "    }",
+    "    return a;",
+    "}",
+    "",
+    "// Divide the word at SP by divisor, setting HI and LO",
+    "static inline void divide(word_type divisor)",
+    "{",
+    "    if (divisor == 0) {",
+    "        bail(\"Error: Attempt to divide by zero!\");",
+    "    }",
+    "    if (divisor == -1) {",
+    "        // (as in the VM, the most negative word divided by -1",
+    "        // wraps around instead of trapping)",
+    "        hilo_regs.hilo[HI] = 0;",
+    "        hilo_regs.hilo[LO] = (word_type) (- U(GPR[SP]));",
+    "        return;",
+    "    }",
+    "    hilo_regs.hilo[HI] = W(GPR[SP]) % divisor;",
+    "    hilo_regs.hilo[LO] = W(GPR[SP]) / divisor;",
+    "}",
+    NULL
+};
+
+// the runtime written into translated programs that may turn on tracing
+// (it prints the machine's state as machine_print_state does)
+static const char *trace_runtime_text[] = {
+    "",
+    "static bool tracing = false;",
+    "static const char *regnames[8] = {",
+    "    \"$gp\", \"$sp\", \"$fp\", \"$r3\", \"$r4\", \"$r5\", \"$r6\", \"$ra\" };",
+    "",
+    "// Print a newline on stdout and flush it",
+    "static void newline(void)",
+    "{",
+    "    fprintf(stdout, \"\\n\");",
+    "    fflush(stdout);",
+    "}",
+    "",
+    "// Print the instruction about to be executed",
+    "static void trace_instr(uword_type addr, const char *asm_form)",
+    "{",
+    "    printf(\"\\n==> %6d: %s\\n\", addr, asm_form);",
+    "}",
+    "",
+    "// Print the nonzero words between start and end (inclusive),",
+    "// eliding repeated zeros; return true if a newline ended the output",
+    "static bool print_memory(int start, int end)",
+    "{",
+    "    bool printed_newline = false;",
+    "    bool previously_zero = false;",
+    "    bool printed_dots = false;",
+    "    int lc = 0;",
+    "    for (int wa = start; wa <= end; wa++) {",
+    "        if (lc > 59) {",
+    "            newline();",
+    "            printed_newline = true;",
+    "            lc = 0;",
+    "        }",
+    "        if (W(wa) != 0 || !previously_zero) {",
+    "            lc += printf(\"%8d: %d\\t\", wa, W(wa));",
+    "            previously_zero = W(wa) == 0;",
+    "            printed_dots = false;",
+    "        } else if (!printed_dots) {",
+    "            lc += printf(\"%s\", \"        ...     \");",
+    "            printed_dots = true;",
+    "        }",
+    "        printed_newline = false;",
+    "    }",
+    "    return printed_newline;",
+    "}",
+    "",
+    "// Print the state of the machine, with the given PC",
+    "static void print_state(uword_type pc)",
+    "{",
+    "    printf(\"%8s: %u\", \"PC\", pc);",
+    "    if (hilo_regs.result != 0L) {",
+    "        printf(\"\\t%8s: %d\\t%8s: %d\", \"HI\", hilo_regs.hilo[HI],",
+    "               \"LO\", hilo_regs.hilo[LO]);",
+    "    }",
+    "    newline();",
+    "    for (int j = 0; j < 8; /* nothing */) {",
+    "        printf(\"GPR[%-3s]: %-5d\", regnames[j], GPR[j]);",
+    "        j++;",
+    "        for (int lc = 0; lc < 4 && j < 8; lc++) {",
+    "            printf(\"\\tGPR[%-3s]: %-5d\", regnames[j], GPR[j]);",
+    "            j++;",
+    "        }",
+    "        newline();",
+    "    }",
+    "    if (!print_memory(GPR[GP], GPR[SP] - 1)) {",
+    "        newline();",
+    "    }",
+    "    if (!print_memory(GPR[SP], STACK_BOTTOM)) {",
+    "        newline();",
+    "    }",
+    "}",
+    NULL
+};
+
+// Print the lines of text (ending with NULL) to out
+static void print_lines(FILE *out, const char *text[])
+{
+    for (int i = 0; text[i] != NULL; i++) {
+	fprintf(out, "%s\n", text[i]);
+    }
+}
+
+// Print the C expression for the address GPR[reg] + off to out
+static void print_address(FILE *out, reg_num_type reg, word_type off)
+{
+    if (off == 0) {
+	fprintf(out, "GPR[%u]", reg);
+    } else if (off < 0) {
+	fprintf(out, "GPR[%u] - %d", reg, -off);
+    } else {
+	fprintf(out, "GPR[%u] + %d", reg, off);
+    }
+}
+
+// no source operand (for print_store)
+#define NO_SOURCE NUM_REGISTERS
+
+// Print a store to the target operand GPR[rt] + ot, using the memory
+// view v ('W' or 'U'), of the value made of before, the address
+// GPR[rs] + os (unless rs is NO_SOURCE) and after, to out
+static void print_store(FILE *out, char v, reg_num_type rt, word_type ot,
+			const char *before, reg_num_type rs, word_type os,
+			const char *after)
+{
+    fprintf(out, "    %c(st(", v);
+    print_address(out, rt, ot);
+    fprintf(out, ")) = %s", before);
+    if (rs != NO_SOURCE) {
+	print_address(out, rs, os);
+    }
+    fprintf(out, "%s;\n", after);
+}
+
+// the state of a translation
+typedef struct {
+    FILE *out;
+    address_type text_length;
+    bool traced;   // may the program turn on tracing?
+} translation;
+
+// Print the code to go to the instruction at target to tr's output
+static void print_goto(translation *tr, address_type target)
+{
+    if (target < tr->text_length) {
+	fprintf(tr->out, "goto a%u;", target);
+    } else {
+	fprintf(tr->out, "{ pc = %u; goto dispatch; }", target);
+    }
+}
+
+// Print the code that continues at pc (which is known to be next when
+// the program is not traced) after the instruction at addr
+static void print_after(translation *tr, address_type addr)
+{
+    if (tr->traced) {
+	fprintf(tr->out, "    if (tracing) print_state(%u);\n", addr + 1);
+    }
+}
+
+// Print the code for a branch at addr, that goes to target if the
+// C condition cond (on the word at the operand GPR[reg] + off,
+// and that at SP) is true
+static void print_branch(translation *tr, address_type addr,
+			 address_type target, const char *cond,
+			 reg_num_type reg, word_type off)
+{
+    FILE *out = tr->out;
+    if (tr->traced) {
+	fprintf(out, "    pc = (W(GPR[SP]) %s W(", cond);
+	print_address(out, reg, off);
+	fprintf(out, ")) ? %u : %u;\n", target, addr + 1);
+	fprintf(out, "    if (tracing) print_state(pc);\n");
+	fprintf(out, "    if (pc == %u) ", target);
+    } else {
+	fprintf(out, "    if (W(GPR[SP]) %s W(", cond);
+	print_address(out, reg, off);
+	fprintf(out, ")) ");
+    }
+    print_goto(tr, target);
+    newline(out);
+}
+
+// Print the code for a branch at addr that compares the word at the
+// operand GPR[reg] + off with 0 (using the relational operator rel)
+static void print_branch_zero(translation *tr, address_type addr,
+			      address_type target, const char *rel,
+			      reg_num_type reg, word_type off)
+{
+    FILE *out = tr->out;
+    if (tr->traced) {
+	fprintf(out, "    pc = (W(");
+	print_address(out, reg, off);
+	fprintf(out, ") %s 0) ? %u : %u;\n", rel, target, addr + 1);
+	fprintf(out, "    if (tracing) print_state(pc);\n");
+	fprintf(out, "    if (pc == %u) ", target);
+    } else {
+	fprintf(out, "    if (W(");
+	print_address(out, reg, off);
+	fprintf(out, ") %s 0) ", rel);
+    }
+    print_goto(tr, target);
+    newline(out);
+}
+
+// Print the code that jumps to target (after setting RA if is_call)
+static void print_jump(translation *tr, address_type addr,
+		       address_type target, bool is_call)
+{
+    if (is_call) {
+	fprintf(tr->out, "    GPR[RA] = %u;\n", addr + 1);
+    }
+    if (tr->traced) {
+	fprintf(tr->out, "    if (tracing) print_state(%u);\n", target);
+    }
+    fprintf(tr->out, "    ");
+    print_goto(tr, target);
+    newline(tr->out);
+}
+
+// Print the code that jumps to the address in the C expression
+// pc_expr (that is an operand GPR[reg] + off if reg != NO_SOURCE)
+static void print_computed_jump(translation *tr, const char *pc_expr,
+				reg_num_type reg, word_type off)
+{
+    fprintf(tr->out, "    pc = %s", pc_expr);
+    if (reg != NO_SOURCE) {
+	fprintf(tr->out, "(");
+	print_address(tr->out, reg, off);
+	fprintf(tr->out, ")");
+    }
+    fprintf(tr->out, ";\n");
+    if (tr->traced) {
+	fprintf(tr->out, "    if (tracing) print_state(pc);\n");
+    }
+    fprintf(tr->out, "    goto dispatch;\n");
+}
+
+// Print the check of the invariant needed after writing register reg
+static void print_check_after_write(translation *tr, reg_num_type reg)
+{
+    if (reg == GP || reg == SP || reg == FP) {
+	fprintf(tr->out, "    okay();\n");
+    }
+}
+
+// Print the code for an invalid instruction bi at addr
+static void print_invalid(translation *tr, address_type addr, bin_instr_t bi)
+{
+    fprintf(tr->out, "    bail(\"Invalid instruction (0x%08x) at address %u!\");\n",
+	    *((uword_type *) &bi), addr);
+}
+
+// Print the code for the computational instruction bi at addr
+static void print_comp(translation *tr, address_type addr, bin_instr_t bi)
+{
+    FILE *out = tr->out;
+    comp_instr_t ci = bi.comp;
+    word_type ot = machine_types_formOffset(ci.ot);
+    word_type os = machine_types_formOffset(ci.os);
+    switch (ci.func) {
+    case NOP_F:
+	break;
+    case ADD_F:
+	print_store(out, 'W', ci.rt, ot, "W(GPR[SP]) + W(", ci.rs, os, ")");
+	break;
+    case SUB_F:
+	print_store(out, 'W', ci.rt, ot, "W(GPR[SP]) - W(", ci.rs, os, ")");
+	break;
+    case CPW_F:
+	print_store(out, 'W', ci.rt, ot, "W(", ci.rs, os, ")");
+	break;
+    case CPR_F:
+	fprintf(out, "    GPR[%u] = GPR[%u];\n", ci.rt, ci.rs);
+	print_check_after_write(tr, ci.rt);
+	break;
+    case AND_F:
+	print_store(out, 'U', ci.rt, ot, "U(GPR[SP]) & U(", ci.rs, os, ")");
+	break;
+    case BOR_F:
+	print_store(out, 'U', ci.rt, ot, "U(GPR[SP]) | U(", ci.rs, os, ")");
+	break;
+    case NOR_F:
+	print_store(out, 'U', ci.rt, ot, "~(U(GPR[SP]) | U(", ci.rs, os, "))");
+	break;
+    case XOR_F:
+	print_store(out, 'U', ci.rt, ot, "U(GPR[SP]) ^ U(", ci.rs, os, ")");
+	break;
+    case LWR_F:
+	fprintf(out, "    GPR[%u] = W(", ci.rt);
+	print_address(out, ci.rs, os);
+	fprintf(out, ");\n");
+	print_check_after_write(tr, ci.rt);
+	break;
+    case SWR_F:
+	print_store(out, 'W', ci.rt, ot, "", ci.rs, 0, "");
+	break;
+    case SCA_F:
+	print_store(out, 'W', ci.rt, ot, "", ci.rs, os, "");
+	break;
+    case LWI_F:
+	print_store(out, 'W', ci.rt, ot, "W(W(", ci.rs, os, "))");
+	break;
+    case NEG_F:
+	print_store(out, 'W', ci.rt, ot, "- W(", ci.rs, os, ")");
+	break;
+    default:
+	print_invalid(tr, addr, bi);
+	return;
+    }
+    print_after(tr, addr);
+}
+
+// Print the code for the system call bi at addr
+static void print_syscall(translation *tr, address_type addr, bin_instr_t bi)
+{
+    FILE *out = tr->out;
+    syscall_instr_t si = bi.syscall;
+    word_type off = machine_types_formOffset(si.offset);
+    switch (si.code) {
+    case exit_sc:
+	fprintf(out, "    exit(%d);\n", machine_types_sgnExt(si.offset));
+	return;
+    case print_str_sc:
+	print_store(out, 'W', SP, 0, "printf(\"%s\", (char *) &W(",
+		    si.reg, off, "))");
+	break;
+    case print_int_sc:
+	print_store(out, 'W', SP, 0, "printf(\"%d\", W(", si.reg, off, "))");
+	break;
+    case print_char_sc:
+	print_store(out, 'W', SP, 0, "fputc(W(", si.reg, off, "), stdout)");
+	break;
+    case read_char_sc:
+	print_store(out, 'W', si.reg, off, "getc(stdin)", NO_SOURCE, 0, "");
+	break;
+    case start_tracing_sc:
+	fprintf(out, "    tracing = true;\n");
+	break;
+    case stop_tracing_sc:
+	if (tr->traced) {
+	    fprintf(out, "    tracing = false;\n");
+	}
+	break;
+    default:
+	print_invalid(tr, addr, bi);
+	return;
+    }
+    print_after(tr, addr);
+}
+
+// Print the code for the other computational instruction bi at addr
+static void print_othc(translation *tr, address_type addr, bin_instr_t bi)
+{
+    FILE *out = tr->out;
+    other_comp_instr_t oci = bi.othc;
+    word_type off = machine_types_formOffset(oci.offset);
+    char value[64];
+    switch (oci.func) {
+    case LIT_F:
+	sprintf(value, "%d", machine_types_sgnExt(oci.arg));
+	print_store(out, 'W', oci.reg, off, value, NO_SOURCE, 0, "");
+	break;
+    case ARI_F: case SRI_F:
+	fprintf(out, "    GPR[%u] = GPR[%u] %c %d;\n", oci.reg, oci.reg,
+		oci.func == ARI_F ? '+' : '-', machine_types_sgnExt(oci.arg));
+	print_check_after_write(tr, oci.reg);
+	break;
+    case MUL_F:
+	fprintf(out, "    hilo_regs.result = (long) W(GPR[SP]) * (long) W(");
+	print_address(out, oci.reg, off);
+	fprintf(out, ");\n");
+	break;
+    case DIV_F:
+	fprintf(out, "    divide(W(");
+	print_address(out, oci.reg, off);
+	fprintf(out, "));\n");
+	break;
+    case CFHI_F:
+	print_store(out, 'W', oci.reg, off, "hilo_regs.hilo[HI]",
+		    NO_SOURCE, 0, "");
+	break;
+    case CFLO_F:
+	print_store(out, 'W', oci.reg, off, "hilo_regs.hilo[LO]",
+		    NO_SOURCE, 0, "");
+	break;
+    case SLL_F: case SRL_F:
+	sprintf(value, "U(GPR[SP]) %s %d", oci.func == SLL_F ? "<<" : ">>",
+		oci.arg);
+	print_store(out, 'U', oci.reg, off, value, NO_SOURCE, 0, "");
+	break;
+    case JMP_F:
+	print_computed_jump(tr, "U", oci.reg, off);
+	return;
+    case CSI_F:
+	fprintf(out, "    GPR[RA] = %u;\n", addr + 1);
+	print_computed_jump(tr, "W", oci.reg, off);
+	return;
+    case JREL_F:
+	print_jump(tr, addr, addr + machine_types_formOffset(oci.arg), false);
+	return;
+    case SYS_F:
+	print_syscall(tr, addr, bi);
+	return;
+    default:
+	print_invalid(tr, addr, bi);
+	return;
+    }
+    print_after(tr, addr);
+}
+
+// Print the code for the instruction with an immediate operand bi at addr
+static void print_immed(translation *tr, address_type addr, bin_instr_t bi)
+{
+    FILE *out = tr->out;
+    immed_instr_t ii = bi.immed;
+    word_type off = machine_types_formOffset(ii.offset);
+    address_type target = addr + machine_types_formOffset(ii.immed);
+    static const char *ops[] = {
+	[ANDI_O] = "&", [BORI_O] = "|", [NORI_O] = "|", [XORI_O] = "^"
+    };
+    char value[64];
+    switch (ii.op) {
+    case ADDI_O:
+	sprintf(value, ") + %d", machine_types_sgnExt(ii.immed));
+	print_store(out, 'W', ii.reg, off, "W(", ii.reg, off, value);
+	break;
+    case ANDI_O: case BORI_O: case NORI_O: case XORI_O:
+	sprintf(value, ") %s %uu%s", ops[ii.op],
+		machine_types_zeroExt(bi.uimmed.uimmed),
+		ii.op == NORI_O ? ")" : "");
+	print_store(out, 'U', ii.reg, off, ii.op == NORI_O ? "~(U(" : "U(",
+		    ii.reg, off, value);
+	break;
+    case BEQ_O:
+	print_branch(tr, addr, target, "==", ii.reg, off);
+	return;
+    case BNE_O:
+	print_branch(tr, addr, target, "!=", ii.reg, off);
+	return;
+    case BGEZ_O:
+	print_branch_zero(tr, addr, target, ">=", ii.reg, off);
+	return;
+    case BGTZ_O:
+	print_branch_zero(tr, addr, target, ">", ii.reg, off);
+	return;
+    case BLEZ_O:
+	print_branch_zero(tr, addr, target, "<=", ii.reg, off);
+	return;
+    case BLTZ_O:
+	print_branch_zero(tr, addr, target, "<", ii.reg, off);
+	return;
+    default:
+	print_invalid(tr, addr, bi);
+	return;
+    }
+    print_after(tr, addr);
+}
+
+// Print a C string literal for str to out
+static void print_string_literal(FILE *out, const char *str)
+{
+    fprintf(out, "\"");
+    for (const char *p = str; *p != '\0'; p++) {
+	if (*p == '"' || *p == '\\') {
+	    fprintf(out, "\\");
+	}
+	fprintf(out, "%c", *p);
+    }
+    fprintf(out, "\"");
+}
+
+// Print the code for the instruction bi, found at address addr
+static void print_instr(translation *tr, address_type addr, bin_instr_t bi)
+{
+    FILE *out = tr->out;
+    fprintf(out, "a%u: // %s\n", addr, instruction_assembly_form(addr, bi));
+    if (tr->traced) {
+	fprintf(out, "    if (tracing) trace_instr(%u, ", addr);
+	print_string_literal(out, instruction_assembly_form(addr, bi));
+	fprintf(out, ");\n");
+    }
+    switch (bi.comp.op) {
+    case COMP_O:
+	print_comp(tr, addr, bi);
+	break;
+    case OTHC_O:
+	print_othc(tr, addr, bi);
+	break;
+    case JMPA_O: case CALL_O:
+	print_jump(tr, addr, machine_types_formAddress(addr, bi.jump.addr),
+		   bi.jump.op == CALL_O);
+	break;
+    case RTN_O:
+	print_computed_jump(tr, "GPR[RA]", NO_SOURCE, 0);
+	break;
+    default:
+	print_immed(tr, addr, bi);
+	break;
+    }
+}
+
+// Print the C array definition of the count words in ws, named name
+static void print_words(FILE *out, const char *name, const word_type ws[],
+			unsigned int count)
+{
+    fprintf(out, "static const word_type %s[] = {", name);
+    for (unsigned int i = 0; i < count; i++) {
+	fprintf(out, "%s%d", (i % 8 == 0) ? "\n    " : " ", ws[i]);
+	if (i + 1 < count) {
+	    fprintf(out, ",");
+	}
+    }
+    // an initializer cannot be empty
+    fprintf(out, "%s\n};\n", count == 0 ? "0" : "");
+}
+
+// Requires: bf is open for reading in binary
+// Translate the program in bf into a self-contained C program,
+// with output going to the file out.
+// When compiled, that program behaves like running bf in the VM
+// (without the -t option), except that it stops with an error
+// if the program changes its own instructions.
+void bof2c_program(FILE *out, BOFFILE bf)
+{
+    BOFHeader bh = bof_read_header(bf);
+    // the same checks as the VM makes when loading a program
+    if (bh.text_length >= bh.data_start_address
+	|| bh.data_start_address + bh.data_length >= bh.stack_bottom_addr
+	|| bh.stack_bottom_addr >= MEMORY_SIZE_IN_WORDS) {
+	bail_with_error("The header's sections do not fit in the VM's memory!");
+    }
+
+    bin_instr_t *instrs = (bin_instr_t *)
+	malloc(sizeof(bin_instr_t) * (bh.text_length + 1));
+    word_type *data = (word_type *)
+	malloc(sizeof(word_type) * (bh.data_length + 1));
+    if (instrs == NULL || data == NULL) {
+	bail_with_error("Cannot allocate space for the program!");
+    }
+    translation tr = { out, bh.text_length, false };
+    for (unsigned int i = 0; i < bh.text_length; i++) {
+	instrs[i] = instruction_read(bf);
+	tr.traced = tr.traced
+	    || (instruction_type(instrs[i]) == syscall_instr_type
+		&& instrs[i].syscall.code == start_tracing_sc);
+    }
+    for (unsigned int i = 0; i < bh.data_length; i++) {
+	data[i] = bof_read_word(bf);
+    }
+
+    fprintf(out, "// Translated from a binary object file by bof2c\n");
+    fprintf(out, "#define TEXT_WORDS %u\n", bh.text_length);
+    fprintf(out, "#define DATA_START %u\n", bh.data_start_address);
+    fprintf(out, "#define DATA_WORDS %u\n", bh.data_length);
+    fprintf(out, "#define STACK_BOTTOM %u\n", bh.stack_bottom_addr);
+    print_lines(out, runtime_text);
+    if (tr.traced) {
+	print_lines(out, trace_runtime_text);
+    }
+    newline(out);
+    print_words(out, "text_words", (word_type *) instrs, bh.text_length);
+    print_words(out, "data_words", data, bh.data_length);
+
+    fprintf(out, "\nint main(int argc, char *argv[])\n{\n");
+    fprintf(out, "    uword_type pc = %u;\n", bh.text_start_address);
+    fprintf(out, "    progname = argv[0];\n");
+    fprintf(out, "    for (int i = 0; i < TEXT_WORDS; i++) {\n"
+	    "        W(i) = text_words[i];\n    }\n");
+    fprintf(out, "    for (int i = 0; i < DATA_WORDS; i++) {\n"
+	    "        W(DATA_START + i) = data_words[i];\n    }\n");
+    fprintf(out, "    GPR[GP] = DATA_START;\n");
+    fprintf(out, "    GPR[SP] = STACK_BOTTOM;\n");
+    fprintf(out, "    GPR[FP] = STACK_BOTTOM;\n");
+    fprintf(out, "    okay();\n");
+    fprintf(out, "    goto dispatch;\n");
+
+    for (unsigned int i = 0; i < bh.text_length; i++) {
+	print_instr(&tr, i, instrs[i]);
+    }
+    // running off the end of the text
+    fprintf(out, "    pc = TEXT_WORDS;\n");
+
+    fprintf(out, "dispatch:\n    switch (pc) {\n");
+    for (unsigned int i = 0; i < bh.text_length; i++) {
+	fprintf(out, "    case %u: goto a%u;\n", i, i);
+    }
+    fprintf(out, "    default:\n"
+	    "        bail(\"The PC (%%u) is outside the program's text;\"\n"
+	    "             \" run it in the VM instead!\", pc);\n");
+    fprintf(out, "    }\n    return 0;\n}\n");
+
+    free(instrs);
+    free(data);
+}
@@ -0,0 +1,15 @@
+// Ahead-of-time translation of binary object files into C programs
+#ifndef _BOF2C_H
+#define _BOF2C_H
+#include <stdio.h>
+#include "bof.h"
+
+// Requires: bf is open for reading in binary
+// Translate the program in bf into a self-contained C program,
+// with output going to the file out.
+// When compiled, that program behaves like running bf in the VM
+// (without the -t option), except that it stops with an error
+// if the program changes its own instructions.
+extern void bof2c_program(FILE *out, BOFFILE bf);
+
+#endif
@@ -0,0 +1,54 @@
+// Edge coverage of guest programs, collected in a fixed-size bitmap
+// of hit counts (in the style of AFL).  Each branch or jump executed
+// increments the counter for the hash of its (from, to) edge;
+// a coverage file holds the COVERAGE_MAP_SIZE counters as bytes.
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "coverage.h"
+#include "utilities.h"
+
+// the counters for the edges (hashed into the map)
+unsigned char coverage_map[COVERAGE_MAP_SIZE];
+
+// is coverage being collected?
+bool coverage_on = false;
+
+// Start collecting coverage (with all counters 0)
+void coverage_start()
+{
+    memset(coverage_map, 0, sizeof(coverage_map));
+    coverage_on = true;
+}
+
+// Merge the coverage map into the one in the file named filename
+// (adding the counts, which stop at 255), creating it if needed.
+// Returns the number of edges (entries) that are nonzero in the result.
+unsigned int coverage_merge_into(const char *filename)
+{
+    static unsigned char merged[COVERAGE_MAP_SIZE];
+    memset(merged, 0, sizeof(merged));
+    FILE *f = fopen(filename, "rb");
+    if (f != NULL) {
+	size_t n = fread(merged, 1, sizeof(merged), f);
+	fclose(f);
+	if (n != sizeof(merged)) {
+	    bail_with_error("Coverage file %s is not %d bytes long!",
+			    filename, COVERAGE_MAP_SIZE);
+	}
+    }
+
+    unsigned int edges = 0;
+    for (int i = 0; i < COVERAGE_MAP_SIZE; i++) {
+	unsigned int sum = merged[i] + coverage_map[i];
+	merged[i] = sum > 255 ? 255 : sum;
+	edges += merged[i] != 0;
+    }
+
+    f = fopen(filename, "wb");
+    if (f == NULL || fwrite(merged, 1, sizeof(merged), f) != sizeof(merged)) {
+	bail_with_error("Cannot write coverage file %s", filename);
+    }
+    fclose(f);
+    return edges;
+}
@@ -0,0 +1,38 @@
+// Edge coverage of guest programs, collected in a fixed-size bitmap
+// of hit counts (in the style of AFL)
+#ifndef _COVERAGE_H
+#define _COVERAGE_H
+#include <stdbool.h>
+#include "machine_types.h"
+
+// the number of (one byte) counters in the coverage map
+#define COVERAGE_MAP_SIZE (1 << 16)
+
+// the counters for the edges (hashed into the map)
+extern unsigned char coverage_map[COVERAGE_MAP_SIZE];
+
+// is coverage being collected?
+extern bool coverage_on;
+
+// Return a hash of the instruction address a
+static inline unsigned int coverage_hash(address_type a)
+{
+    return (a * 0x9E3779B1u) >> 16;
+}
+
+// Record that the branch or jump at from went to the address to
+static inline void coverage_edge(address_type from, address_type to)
+{
+    coverage_map[(coverage_hash(from) ^ (coverage_hash(to) >> 1))
+		 & (COVERAGE_MAP_SIZE - 1)]++;
+}
+
+// Start collecting coverage (with all counters 0)
+extern void coverage_start();
+
+// Merge the coverage map into the one in the file named filename
+// (adding the counts, which stop at 255), creating it if needed.
+// Returns the number of edges (entries) that are nonzero in the result.
+extern unsigned int coverage_merge_into(const char *filename);
+
+#endif
@@ -0,0 +1,224 @@
+// An interactive debugger for the VM (vm -g).
+// A breakpoint replaces the instruction at its address with a trap
+// instruction (see MACHINE_TRAP_F), so the program runs at full speed
+// until it reaches one; the original instruction is saved here.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "machine.h"
+#include "machine_state.h"
+#include "instruction.h"
+#include "ir_engine.h"
+#include "debugger.h"
+#include "watchpoints.h"
+#include "utilities.h"
+
+// the longest command line read
+#define MAX_COMMAND_LENGTH 256
+
+// is_breakpoint[a] is true when there is a breakpoint at address a,
+// and then saved_instrs[a] is the instruction it replaced
+static bool is_breakpoint[MEMORY_SIZE_IN_WORDS];
+static bin_instr_t saved_instrs[MEMORY_SIZE_IN_WORDS];
+
+// Return the trap instruction used for breakpoints
+static bin_instr_t trap_instr()
+{
+    bin_instr_t ret;
+    ret.othc.op = OTHC_O;
+    ret.othc.reg = 0;
+    ret.othc.offset = 0;
+    ret.othc.arg = 0;
+    ret.othc.func = MACHINE_TRAP_F;
+    return ret;
+}
+
+// Store bi at the address addr of the program's text
+// (forgetting any translations of the old instruction)
+static void patch_text(address_type addr, bin_instr_t bi)
+{
+    memory.instrs[addr] = bi;
+    ir_engine_flush();
+}
+
+// Return the program's instruction at addr (not a breakpoint's trap)
+static bin_instr_t program_instr(address_type addr)
+{
+    return is_breakpoint[addr] ? saved_instrs[addr] : memory.instrs[addr];
+}
+
+// Set a breakpoint at addr, if it is in the program's text
+static void set_breakpoint(address_type addr)
+{
+    if (addr >= instruction_words) {
+	printf("No instruction at address %u\n", addr);
+    } else if (!is_breakpoint[addr]) {
+	saved_instrs[addr] = memory.instrs[addr];
+	is_breakpoint[addr] = true;
+	patch_text(addr, trap_instr());
+    }
+}
+
+// Delete the breakpoint at addr (if any)
+static void delete_breakpoint(address_type addr)
+{
+    if (addr < MEMORY_SIZE_IN_WORDS && is_breakpoint[addr]) {
+	is_breakpoint[addr] = false;
+	patch_text(addr, saved_instrs[addr]);
+    }
+}
+
+// Print the breakpoints
+static void list_breakpoints()
+{
+    for (address_type a = 0; a < instruction_words; a++) {
+	if (is_breakpoint[a]) {
+	    instruction_print(stdout, a, saved_instrs[a]);
+	}
+    }
+}
+
+// Requires: the program is running
+// Execute the program's instruction at the PC,
+// even if there is a breakpoint there.
+// Returns true if the program is still running.
+static bool step()
+{
+    address_type addr = PC;
+    if (!is_breakpoint[addr]) {
+	return machine_step();
+    }
+    // run the saved instruction, then put the trap back
+    patch_text(addr, saved_instrs[addr]);
+    bool ret = machine_step();
+    if (is_breakpoint[addr]) {
+	patch_text(addr, trap_instr());
+    }
+    return ret;
+}
+
+// Print the instruction at the PC (where the program is stopped)
+static void print_stop()
+{
+    instruction_print(stdout, PC, program_instr(PC));
+}
+
+// Print count memory words starting at addr
+static void examine_memory(address_type addr, unsigned int count)
+{
+    for (unsigned int i = 0; i < count && addr + i < MEMORY_SIZE_IN_WORDS;
+	 i++) {
+	printf("%8u: %d\n", addr + i, memory.words[addr + i]);
+    }
+}
+
+// Print a summary of the debugger's commands
+static void print_help()
+{
+    printf("Commands:\n"
+	   "  b ADDR      set a breakpoint at the instruction address ADDR\n"
+	   "  d ADDR      delete the breakpoint at ADDR\n"
+	   "  l           list the breakpoints\n"
+	   "  c           continue until a breakpoint or the program exits\n"
+	   "  s [N]       execute N (default 1) instructions\n"
+	   "  r           print the registers, globals and stack\n"
+	   "  x ADDR [N]  print N (default 1) memory words starting at ADDR\n"
+	   "  w ADDR      watch writes to the memory word at ADDR\n"
+	   "  q           quit\n");
+}
+
+// Requires: a program has been loaded into the machine.
+// Run the program under the control of the debugger,
+// reading commands from the terminal (or stdin if there is none).
+// Returns the program's exit code
+int debugger_run()
+{
+    // the program may read stdin, so commands come from the terminal
+    FILE *cmds = fopen("/dev/tty", "r");
+    if (cmds == NULL) {
+	cmds = stdin;
+    }
+    tracing = false;
+    print_stop();
+    char line[MAX_COMMAND_LENGTH];
+    while (running) {
+	printf("(vm) ");
+	fflush(stdout);
+	if (fgets(line, sizeof(line), cmds) == NULL) {
+	    break;
+	}
+	char cmd = '\0';
+	long arg1 = -1;
+	long arg2 = -1;
+	int n = sscanf(line, " %c %ld %ld", &cmd, &arg1, &arg2);
+	if (n < 1) {
+	    continue;
+	}
+	switch (cmd) {
+	case 'b':
+	    if (n >= 2 && arg1 >= 0) {
+		set_breakpoint(arg1);
+	    } else {
+		print_help();
+	    }
+	    break;
+	case 'd':
+	    if (n >= 2 && arg1 >= 0) {
+		delete_breakpoint(arg1);
+	    } else {
+		print_help();
+	    }
+	    break;
+	case 'l':
+	    list_breakpoints();
+	    break;
+	case 'c':
+	    // get past a breakpoint at the PC first
+	    if (step() && machine_continue()) {
+		printf("Breakpoint at ");
+		print_stop();
+	    }
+	    break;
+	case 's':
+	    for (long i = 0; i < (n >= 2 ? arg1 : 1) && running; i++) {
+		step();
+	    }
+	    if (running) {
+		print_stop();
+	    }
+	    break;
+	case 'r':
+	    machine_print_state(stdout);
+	    break;
+	case 'x':
+	    if (n >= 2 && arg1 >= 0) {
+		examine_memory(arg1, n >= 3 && arg2 > 0 ? arg2 : 1);
+	    } else {
+		print_help();
+	    }
+	    break;
+	case 'w':
+	    if (n >= 2 && arg1 >= 0 && arg1 < MEMORY_SIZE_IN_WORDS) {
+		watchpoints_add(arg1);
+	    } else {
+		print_help();
+	    }
+	    break;
+	case 'q':
+	    running = false;
+	    break;
+	default:
+	    print_help();
+	    break;
+	}
+	if (!running && cmd != 'q') {
+	    printf("\nThe program exited with code %d\n", exit_code);
+	}
+    }
+    if (cmds != stdin) {
+	fclose(cmds);
+    }
+    fflush(stdout);
+    return exit_code;
+}
@@ -0,0 +1,12 @@
+// An interactive debugger for the VM (vm -g),
+// with breakpoints made by putting trap instructions in the program
+#ifndef _DEBUGGER_H
+#define _DEBUGGER_H
+
+// Requires: a program has been loaded into the machine.
+// Run the program under the control of the debugger,
+// reading commands from the terminal (or stdin if there is none).
+// Returns the program's exit code
+extern int debugger_run();
+
+#endif
@@ -1,5 +1,7 @@
 /* $Id: disasm.c,v 1.14 2024/07/28 22:01:51 leavens Exp $ */
 #include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
 #include "disasm.h"
 #include "bof.h"
 #include "regname.h"
@@ -18,6 +20,96 @@ void disasmProgram(FILE *out, BOFFILE bf)
     newline(out);
 }
 
+// Disassemble code from bf, with output going to the file out,
+// using num_threads threads to disassemble the text section
+void disasmProgramParallel(FILE *out, BOFFILE bf, int num_threads)
+{
+    BOFHeader bh = bof_read_header(bf);
+    fprintf(out, ".text\t%u", bh.text_start_address);
+    newline(out);
+    disasmInstrsParallel(out, bf, bh.text_length, num_threads);
+    disasmDataSection(out, bf, bh);
+    disasmStackSection(out, bh);
+    fprintf(out, ".end");
+    newline(out);
+}
+
+// the most chars in one disassembled line of the text section
+#define MAX_LINE_LENGTH (INSTR_BUF_SIZE + 16)
+
+// A contiguous part of the text section, disassembled by one thread
+// into a buffer of its own
+typedef struct {
+    const bin_instr_t *instrs; // the whole text section
+    address_type start;        // first address of this chunk
+    address_type end;          // one past the last address of this chunk
+    char *text;                // the disassembled lines
+    size_t length;             // number of chars in text
+    size_t capacity;           // size of text
+} text_chunk;
+
+// Disassemble the instructions in the chunk (a text_chunk *)
+// into the chunk's buffer, returning NULL
+static void *disasmChunk(void *arg)
+{
+    text_chunk *chunk = (text_chunk *) arg;
+    char instr_buf[INSTR_BUF_SIZE];
+    for (address_type i = chunk->start; i < chunk->end; i++) {
+	if (chunk->capacity - chunk->length < MAX_LINE_LENGTH) {
+	    chunk->capacity = 2 * chunk->capacity + MAX_LINE_LENGTH;
+	    chunk->text = (char *) realloc(chunk->text, chunk->capacity);
+	    if (chunk->text == NULL) {
+		bail_with_error("Cannot allocate space to disassemble!");
+	    }
+	}
+	const char *form = instruction_assembly_form_into(instr_buf, i,
+							  chunk->instrs[i]);
+	chunk->length += sprintf(chunk->text + chunk->length,
+				 "a%d:\t%s\n", i, form);
+    }
+    return NULL;
+}
+
+// Disassemble length instructions from bf
+// with output going to the file out,
+// splitting the work among num_threads threads
+// (the output is the same as disasmInstrs produces)
+void disasmInstrsParallel(FILE *out, BOFFILE bf, int length, int num_threads)
+{
+    if (length <= 0) {
+	return;
+    }
+    if (num_threads > length) {
+	num_threads = length;
+    }
+    bin_instr_t *instrs = (bin_instr_t *) malloc(length * sizeof(bin_instr_t));
+    text_chunk *chunks = (text_chunk *) calloc(num_threads, sizeof(text_chunk));
+    pthread_t *threads = (pthread_t *) malloc(num_threads * sizeof(pthread_t));
+    if (instrs == NULL || chunks == NULL || threads == NULL) {
+	bail_with_error("Cannot allocate space to disassemble!");
+    }
+    for (int i = 0; i < length; i++) {
+	instrs[i] = instruction_read(bf);
+    }
+    for (int t = 0; t < num_threads; t++) {
+	chunks[t].instrs = instrs;
+	chunks[t].start = (address_type) ((long) length * t / num_threads);
+	chunks[t].end = (address_type) ((long) length * (t+1) / num_threads);
+	if (pthread_create(&threads[t], NULL, disasmChunk, &chunks[t]) != 0) {
+	    bail_with_error("Cannot create a disassembly thread!");
+	}
+    }
+    // write the chunks in order, as each one is finished
+    for (int t = 0; t < num_threads; t++) {
+	pthread_join(threads[t], NULL);
+	fwrite(chunks[t].text, 1, chunks[t].length, out);
+	free(chunks[t].text);
+    }
+    free(threads);
+    free(chunks);
+    free(instrs);
+}
+
 // Disassemble the text section
 // with output going to the file out
 void disasmTextSection(FILE *out, BOFFILE bf, BOFHeader bh)
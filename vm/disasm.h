@@ -7,6 +7,10 @@
 // with output going to the file out
 extern void disasmProgram(FILE *out, BOFFILE bf);
 
+// Disassemble code from bf, with output going to the file out,
+// using num_threads threads to disassemble the text section
+extern void disasmProgramParallel(FILE *out, BOFFILE bf, int num_threads);
+
 // Disassemble the text section
 // with output going to the file out
 extern void disasmTextSection(FILE *out, BOFFILE bf, BOFHeader bh);
@@ -15,6 +19,13 @@ extern void disasmTextSection(FILE *out, BOFFILE bf, BOFHeader bh);
 // with output going to the file out
 extern void disasmInstrs(FILE *out, BOFFILE bf, int length);
 
+// Disassemble length instructions from bf
+// with output going to the file out,
+// splitting the work among num_threads threads
+// (the output is the same as disasmInstrs produces)
+extern void disasmInstrsParallel(FILE *out, BOFFILE bf, int length,
+				 int num_threads);
+
 // Disassemble the binary instruction bi, which would go at address i
 // each instruction has a label of the form a%d, where %d is the value of i
 extern void disasmInstr(FILE *out, bin_instr_t bi, address_type i);
@@ -1,14 +1,18 @@
 /* $Id: disasm_main.c,v 1.3 2023/09/16 12:32:30 leavens Exp $ */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "bof.h"
 #include "disasm.h"
 #include "utilities.h"
 
+// size of the output buffer used with -j
+#define DISASM_OUTPUT_BUF_SIZE (1 << 20)
+
 static char *progname;
 
 void usage() {
-    bail_with_error("Usage: %s file.bof", progname);
+    bail_with_error("Usage: %s [-j N] file.bof", progname);
 }
 
 int main(int argc, char *argv[]) {
@@ -17,6 +21,17 @@ int main(int argc, char *argv[]) {
     argc--;
     argv++;
 
+    // number of threads used to disassemble the text section (with -j)
+    int num_threads = 0;
+    if (argc >= 2 && strcmp(argv[0], "-j") == 0) {
+	num_threads = atoi(argv[1]);
+	if (num_threads <= 0) {
+	    usage();
+	}
+	argc -= 2;
+	argv += 2;
+    }
+
     if (argc != 1) {
 	usage();
     }
@@ -26,7 +41,13 @@ int main(int argc, char *argv[]) {
     
     BOFFILE bf = bof_read_open(bofname);
 
-    disasmProgram(stdout, bf);
+    if (num_threads > 0) {
+	// the chunks are written with large writes, so buffer them fully
+	setvbuf(stdout, NULL, _IOFBF, DISASM_OUTPUT_BUF_SIZE);
+	disasmProgramParallel(stdout, bf, num_threads);
+    } else {
+	disasmProgram(stdout, bf);
+    }
     
     return EXIT_SUCCESS;
 }
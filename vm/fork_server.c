@@ -0,0 +1,213 @@
+// A fork server for repeated runs of one loaded program.
+// A client connects to the server's socket and sends its standard
+// input, output and error file descriptors (as SCM_RIGHTS ancillary data).
+// The server forks a monitor process for the client, which forks the
+// run itself: a copy of the loaded VM with the client's descriptors as
+// its stdin, stdout and stderr.  When the run ends, the monitor sends its wait
+// status (an int) to the client, so the client sees the run's exit
+// code, even if the run was stopped by a signal (e.g., an assertion).
+// (SCM_RIGHTS and the socket calls need _GNU_SOURCE)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "machine.h"
+#include "fork_server.h"
+#include "utilities.h"
+
+#ifndef _WIN32
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+// the most clients waiting to be accepted
+#define LISTEN_BACKLOG 128
+// the number of descriptors a client sends (its stdin, stdout and stderr)
+#define NUM_FDS 3
+
+// Set *addr to the address of the Unix-domain socket at socket_path
+static void socket_address(struct sockaddr_un *addr, const char *socket_path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr->sun_path)) {
+	bail_with_error("Socket path is too long: %s", socket_path);
+    }
+    strcpy(addr->sun_path, socket_path);
+}
+
+// Receive the client's stdin, stdout and stderr descriptors on conn
+// into fds,
+// returning false if they were not sent
+static bool receive_fds(int conn, int fds[NUM_FDS])
+{
+    char byte;
+    struct iovec iov = { &byte, 1 };
+    union {
+	char buf[CMSG_SPACE(NUM_FDS * sizeof(int))];
+	struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    if (recvmsg(conn, &msg, 0) <= 0) {
+	return false;
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET
+	|| cmsg->cmsg_type != SCM_RIGHTS
+	|| cmsg->cmsg_len != CMSG_LEN(NUM_FDS * sizeof(int))) {
+	return false;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), NUM_FDS * sizeof(int));
+    return true;
+}
+
+// Send the descriptors in fds to the server on conn
+static void send_fds(int conn, const int fds[NUM_FDS])
+{
+    char byte = 0;
+    struct iovec iov = { &byte, 1 };
+    union {
+	char buf[CMSG_SPACE(NUM_FDS * sizeof(int))];
+	struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(NUM_FDS * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, NUM_FDS * sizeof(int));
+    if (sendmsg(conn, &msg, 0) < 0) {
+	bail_with_error("Cannot send the descriptors to the fork server");
+    }
+}
+
+// Serve the client connected on conn (in the monitor process):
+// run the program with its descriptors and send it the wait status
+static void serve_client(int conn, bool trace_execution)
+{
+    // (the server ignores SIGCHLD, but the monitor waits for the run)
+    signal(SIGCHLD, SIG_DFL);
+    int fds[NUM_FDS];
+    if (!receive_fds(conn, fds)) {
+	exit(EXIT_FAILURE);
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+	// the run: the VM is already loaded, so start the program
+	close(conn);
+	if (dup2(fds[0], STDIN_FILENO) < 0
+	    || dup2(fds[1], STDOUT_FILENO) < 0
+	    || dup2(fds[2], STDERR_FILENO) < 0) {
+	    bail_with_error("Cannot redirect the run's standard I/O");
+	}
+	for (int i = 0; i < NUM_FDS; i++) {
+	    close(fds[i]);
+	}
+	exit(machine_run(trace_execution));
+    }
+    for (int i = 0; i < NUM_FDS; i++) {
+	close(fds[i]);
+    }
+    int status = EXIT_FAILURE << 8;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+	status = EXIT_FAILURE << 8;
+    }
+    if (write(conn, &status, sizeof(status)) != sizeof(status)) {
+	exit(EXIT_FAILURE);
+    }
+    exit(EXIT_SUCCESS);
+}
+
+// Requires: a program has been loaded (with machine_load) but not run.
+// Listen on the Unix-domain socket at socket_path, and for each client
+// (see fork_server_client) run the program in a forked copy of the VM
+// with the client's standard input, output and error output,
+// sending the run's wait status back to the client when it is done.
+// Execution is traced if trace_execution is true. This does not return.
+void fork_server_serve(const char *socket_path, bool trace_execution)
+{
+    struct sockaddr_un addr;
+    socket_address(&addr, socket_path);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);
+    if (listen_fd < 0
+	|| bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+	|| listen(listen_fd, LISTEN_BACKLOG) != 0) {
+	bail_with_error("Cannot listen on %s", socket_path);
+    }
+    // the monitors are not waited for
+    signal(SIGCHLD, SIG_IGN);
+    // nothing buffered should be copied into the runs
+    fflush(stdout);
+    for (;;) {
+	int conn = accept(listen_fd, NULL, NULL);
+	if (conn < 0) {
+	    continue;
+	}
+	pid_t pid = fork();
+	if (pid == 0) {
+	    close(listen_fd);
+	    serve_client(conn, trace_execution);
+	}
+	close(conn);
+    }
+}
+
+// Have the fork server listening at socket_path run its program
+// with this process's standard input, output and error output.
+// Returns the run's exit code (128 plus the signal number, if the
+// run was stopped by a signal).
+int fork_server_client(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    socket_address(&addr, socket_path);
+    int conn = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (conn < 0
+	|| connect(conn, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+	bail_with_error("Cannot connect to the fork server at %s",
+			socket_path);
+    }
+    fflush(stdout);
+    int fds[NUM_FDS] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    send_fds(conn, fds);
+    int status;
+    if (read(conn, &status, sizeof(status)) != sizeof(status)) {
+	bail_with_error("The fork server did not report the run's status");
+    }
+    close(conn);
+    if (WIFSIGNALED(status)) {
+	return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+#else  // no fork or Unix-domain sockets
+
+// The fork server is not available without fork
+void fork_server_serve(const char *socket_path, bool trace_execution)
+{
+    bail_with_error("The fork server is not supported on this system");
+}
+
+// The fork server is not available without fork
+int fork_server_client(const char *socket_path)
+{
+    bail_with_error("The fork server is not supported on this system");
+    return EXIT_FAILURE;
+}
+
+#endif
@@ -0,0 +1,22 @@
+// A fork server for repeated runs of one loaded program:
+// the program is loaded once, and each run is a copy-on-write copy
+// of the loaded VM (made with fork) that starts at its first instruction
+#ifndef _FORK_SERVER_H
+#define _FORK_SERVER_H
+#include <stdbool.h>
+
+// Requires: a program has been loaded (with machine_load) but not run.
+// Listen on the Unix-domain socket at socket_path, and for each client
+// (see fork_server_client) run the program in a forked copy of the VM
+// with the client's standard input, output and error output,
+// sending the run's wait status back to the client when it is done.
+// Execution is traced if trace_execution is true. This does not return.
+extern void fork_server_serve(const char *socket_path, bool trace_execution);
+
+// Have the fork server listening at socket_path run its program
+// with this process's standard input, output and error output.
+// Returns the run's exit code (128 plus the signal number, if the
+// run was stopped by a signal).
+extern int fork_server_client(const char *socket_path);
+
+#endif
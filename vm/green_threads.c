@@ -0,0 +1,579 @@
+// Serving many interactive sessions of the loaded program,
+// each one an instance of the VM run as a green thread.
+// Each instance has its own memory and registers (copied from the
+// loaded program when its session starts) and is interpreted here,
+// so many of them can run on one OS thread.
+// Each worker thread accepts connections and runs its instances in turn,
+// each for GREEN_THREADS_QUANTUM instructions and until its next
+// backward branch or jump (so straight-line code is never interrupted).
+// An instance that executes RCH with no input available is parked
+// (with its PC still at the RCH) until poll says its connection
+// is readable.
+// (accept, poll and the socket calls need _GNU_SOURCE)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "machine_types.h"
+#include "machine_state.h"
+#include "instruction.h"
+#include "green_threads.h"
+#include "utilities.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// the most connections waiting to be accepted
+#define LISTEN_BACKLOG 128
+// size of each instance's input buffer
+#define INPUT_BUF_SIZE 256
+
+// what happened when an instance ran
+typedef enum { keep_going, turn_over, parked, finished } turn_result;
+
+// one instance of the program (a green thread)
+typedef struct {
+    int fd;            // the session's connection
+    FILE *out;         // its output (buffered, flushed after each turn)
+    unsigned char input[INPUT_BUF_SIZE];
+    int input_pos;     // the next char to read in input
+    int input_len;     // the number of chars in input
+    bool input_closed; // has the other end stopped sending?
+    bool is_parked;    // is it waiting for input?
+    word_type *mem;    // its memory (MEMORY_SIZE_IN_WORDS words)
+    word_type GPR[NUM_REGISTERS];
+    address_type PC;
+    union longAs2words_u hilo_regs;
+} instance;
+
+// the state of one worker thread
+typedef struct {
+    int listen_fd;
+    instance **instances;
+    int num_instances;
+    int capacity;
+} worker;
+
+// the loaded program's initial registers and PC, shared by all sessions
+static word_type initial_GPR[NUM_REGISTERS];
+static address_type initial_PC;
+
+// where words read or written outside the memory go,
+// after their instance is stopped (one per thread)
+static _Thread_local word_type scratch_word;
+// did the instance that is running make an error?
+static _Thread_local bool failed;
+
+// Report an error (msg) on the instance's connection and stop it
+static void fail(instance *in, const char *msg)
+{
+    if (!failed) {
+	fprintf(in->out, "\n%s\n", msg);
+	failed = true;
+    }
+}
+
+// Return a pointer to the word at address wa in the instance's memory
+// (stopping the instance if wa is not in the memory)
+static inline word_type *word_at(instance *in, address_type wa)
+{
+    if (wa >= MEMORY_SIZE_IN_WORDS) {
+	fail(in, "Error: Address is outside the VM's memory!");
+	return &scratch_word;
+    }
+    return &in->mem[wa];
+}
+
+// Return a pointer to the word at GPR[r] + offset in the instance's memory
+static inline word_type *reg_word(instance *in, reg_num_type r,
+				  word_type offset)
+{
+    return word_at(in, in->GPR[r] + offset);
+}
+
+// Read a char of input for the instance into *c, returning false
+// (and reading nothing) if none is available yet
+static bool read_input(instance *in, word_type *c)
+{
+    if (in->input_pos == in->input_len && !in->input_closed) {
+	ssize_t n = recv(in->fd, in->input, INPUT_BUF_SIZE, MSG_DONTWAIT);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+	    return false;
+	}
+	in->input_pos = 0;
+	in->input_len = (n > 0) ? n : 0;
+	in->input_closed = (n <= 0);
+    }
+    if (in->input_pos < in->input_len) {
+	*c = in->input[in->input_pos++];
+    } else {
+	*c = EOF;
+    }
+    return true;
+}
+
+// Requires: the instance is not failed.
+// Execute the instruction at the instance's PC, returning finished if it
+// exited, parked if it must wait for input, turn_over if the
+// instruction was a branch or jump that went backward (or did not move),
+// and keep_going otherwise
+static turn_result execute(instance *in)
+{
+    address_type addr = in->PC;
+    bin_instr_t bi;
+    memcpy(&bi, word_at(in, addr), sizeof(bi));
+    if (failed) {
+	return finished;
+    }
+    word_type sp = in->GPR[SP];
+    in->PC = addr + 1;
+    switch (instruction_type(bi)) {
+    case comp_instr_type:
+	{
+	    comp_instr_t ci = bi.comp;
+	    word_type ot = machine_types_formOffset(ci.ot);
+	    word_type os = machine_types_formOffset(ci.os);
+	    switch (ci.func) {
+	    case NOP_F:
+		break;
+	    case ADD_F:
+		*reg_word(in, ci.rt, ot) = (uword_type) *word_at(in, sp)
+		    + (uword_type) *reg_word(in, ci.rs, os);
+		break;
+	    case SUB_F:
+		*reg_word(in, ci.rt, ot) = (uword_type) *word_at(in, sp)
+		    - (uword_type) *reg_word(in, ci.rs, os);
+		break;
+	    case CPW_F:
+		*reg_word(in, ci.rt, ot) = *reg_word(in, ci.rs, os);
+		break;
+	    case CPR_F:
+		in->GPR[ci.rt] = in->GPR[ci.rs];
+		break;
+	    case AND_F:
+		*reg_word(in, ci.rt, ot) = *word_at(in, sp)
+		    & *reg_word(in, ci.rs, os);
+		break;
+	    case BOR_F:
+		*reg_word(in, ci.rt, ot) = *word_at(in, sp)
+		    | *reg_word(in, ci.rs, os);
+		break;
+	    case NOR_F:
+		*reg_word(in, ci.rt, ot) = ~(*word_at(in, sp)
+					     | *reg_word(in, ci.rs, os));
+		break;
+	    case XOR_F:
+		*reg_word(in, ci.rt, ot) = *word_at(in, sp)
+		    ^ *reg_word(in, ci.rs, os);
+		break;
+	    case LWR_F:
+		in->GPR[ci.rt] = *reg_word(in, ci.rs, os);
+		break;
+	    case SWR_F:
+		*reg_word(in, ci.rt, ot) = in->GPR[ci.rs];
+		break;
+	    case SCA_F:
+		*reg_word(in, ci.rt, ot) = in->GPR[ci.rs] + os;
+		break;
+	    case LWI_F:
+		*reg_word(in, ci.rt, ot) = *word_at(in, *reg_word(in, ci.rs, os));
+		break;
+	    case NEG_F:
+		*reg_word(in, ci.rt, ot) = - (uword_type) *reg_word(in, ci.rs, os);
+		break;
+	    default:
+		fail(in, "Error: Invalid function code in a computational instruction!");
+		break;
+	    }
+	}
+	break;
+    case other_comp_instr_type:
+	{
+	    other_comp_instr_t oci = bi.othc;
+	    word_type off = machine_types_formOffset(oci.offset);
+	    switch (oci.func) {
+	    case LIT_F:
+		*reg_word(in, oci.reg, machine_types_sgnExt(oci.offset))
+		    = machine_types_sgnExt(oci.arg);
+		break;
+	    case ARI_F:
+		in->GPR[oci.reg] += machine_types_sgnExt(oci.arg);
+		break;
+	    case SRI_F:
+		in->GPR[oci.reg] -= machine_types_sgnExt(oci.arg);
+		break;
+	    case MUL_F:
+		in->hilo_regs.result = (long) *word_at(in, sp)
+		    * (long) *reg_word(in, oci.reg, off);
+		break;
+	    case DIV_F:
+		{
+		    word_type divisor = *reg_word(in, oci.reg, off);
+		    if (divisor == 0) {
+			fail(in, "Error: Attempt to divide by zero!");
+			break;
+		    }
+		    machine_types_divide(*word_at(in, sp), divisor,
+					 &in->hilo_regs.hilo[LO],
+					 &in->hilo_regs.hilo[HI]);
+		}
+		break;
+	    case CFHI_F:
+		*reg_word(in, oci.reg, off) = in->hilo_regs.hilo[HI];
+		break;
+	    case CFLO_F:
+		*reg_word(in, oci.reg, off) = in->hilo_regs.hilo[LO];
+		break;
+	    case SLL_F:
+		*reg_word(in, oci.reg, off)
+		    = (uword_type) *word_at(in, sp) << oci.arg;
+		break;
+	    case SRL_F:
+		*reg_word(in, oci.reg, off)
+		    = (uword_type) *word_at(in, sp) >> oci.arg;
+		break;
+	    case JMP_F:
+		in->PC = *reg_word(in, oci.reg, off);
+		break;
+	    case CSI_F:
+		in->GPR[RA] = in->PC;
+		in->PC = *reg_word(in, oci.reg, off);
+		break;
+	    case JREL_F:
+		in->PC = addr + machine_types_formOffset(oci.arg);
+		break;
+	    default:
+		fail(in, "Error: Invalid function code in an other computational instruction!");
+		break;
+	    }
+	}
+	break;
+    case syscall_instr_type:
+	{
+	    syscall_instr_t si = bi.syscall;
+	    word_type off = machine_types_formOffset(si.offset);
+	    switch (si.code) {
+	    case exit_sc:
+		return finished;
+	    case print_str_sc:
+		{
+		    address_type wa = in->GPR[si.reg] + off;
+		    if (wa >= MEMORY_SIZE_IN_WORDS) {
+			fail(in, "Error: Address is outside the VM's memory!");
+			break;
+		    }
+		    size_t max_len = (MEMORY_SIZE_IN_WORDS - wa) * BYTES_PER_WORD;
+		    size_t len = strnlen((char *) &in->mem[wa], max_len);
+		    fwrite(&in->mem[wa], 1, len, in->out);
+		    *word_at(in, sp) = len;
+		}
+		break;
+	    case print_int_sc:
+		*word_at(in, sp) = fprintf(in->out, "%d",
+					   *reg_word(in, si.reg, off));
+		break;
+	    case print_char_sc:
+		*word_at(in, sp) = fputc(*reg_word(in, si.reg, off), in->out);
+		break;
+	    case read_char_sc:
+		{
+		    word_type c;
+		    if (!read_input(in, &c)) {
+			// run the RCH again when there is input
+			in->PC = addr;
+			return parked;
+		    }
+		    *reg_word(in, si.reg, off) = c;
+		}
+		break;
+	    case start_tracing_sc: case stop_tracing_sc:
+		// tracing is not done for sessions
+		break;
+	    default:
+		fail(in, "Error: Invalid system call!");
+		break;
+	    }
+	}
+	break;
+    case immed_instr_type:
+	{
+	    immed_instr_t ii = bi.immed;
+	    uimmed_instr_t ui = bi.uimmed;
+	    word_type off = machine_types_formOffset(ii.offset);
+	    address_type taken = addr + machine_types_formOffset(ii.immed);
+	    bool cond = false;
+	    switch (ii.op) {
+	    case ADDI_O:
+		{
+		    word_type *w = reg_word(in, ii.reg, off);
+		    *w = (uword_type) *w + machine_types_sgnExt(ii.immed);
+		}
+		return keep_going;
+	    case ANDI_O:
+		*reg_word(in, ui.reg, off) &= machine_types_zeroExt(ui.uimmed);
+		return keep_going;
+	    case BORI_O:
+		*reg_word(in, ui.reg, off) |= machine_types_zeroExt(ui.uimmed);
+		return keep_going;
+	    case NORI_O:
+		{
+		    word_type *w = reg_word(in, ui.reg, off);
+		    *w = ~(*w | machine_types_zeroExt(ui.uimmed));
+		}
+		return keep_going;
+	    case XORI_O:
+		*reg_word(in, ui.reg, off) ^= machine_types_zeroExt(ui.uimmed);
+		return keep_going;
+	    case BEQ_O:
+		cond = *word_at(in, sp) == *reg_word(in, ii.reg, off);
+		break;
+	    case BGEZ_O:
+		cond = *reg_word(in, ii.reg, off) >= 0;
+		break;
+	    case BGTZ_O:
+		cond = *reg_word(in, ii.reg, off) > 0;
+		break;
+	    case BLEZ_O:
+		cond = *reg_word(in, ii.reg, off) <= 0;
+		break;
+	    case BLTZ_O:
+		cond = *reg_word(in, ii.reg, off) < 0;
+		break;
+	    case BNE_O:
+		cond = *word_at(in, sp) != *reg_word(in, ii.reg, off);
+		break;
+	    default:
+		fail(in, "Error: Invalid opcode in an immediate instruction!");
+		return keep_going;
+	    }
+	    if (cond) {
+		in->PC = taken;
+	    }
+	}
+	break;
+    case jump_instr_type:
+	{
+	    jump_instr_t ji = bi.jump;
+	    switch (ji.op) {
+	    case JMPA_O:
+		in->PC = machine_types_formAddress(addr, ji.addr);
+		break;
+	    case CALL_O:
+		in->GPR[RA] = in->PC;
+		in->PC = machine_types_formAddress(addr, ji.addr);
+		break;
+	    case RTN_O:
+		in->PC = in->GPR[RA];
+		break;
+	    default:
+		fail(in, "Error: Invalid opcode in a jump instruction!");
+		break;
+	    }
+	}
+	break;
+    default:
+	fail(in, "Error: Invalid instruction type!");
+	break;
+    }
+    return (in->PC <= addr) ? turn_over : keep_going;
+}
+
+// Run the instance for its turn: at least GREEN_THREADS_QUANTUM
+// instructions, up to the next backward branch or jump after those,
+// stopping early if it must wait for input or it stops
+static turn_result run_turn(instance *in)
+{
+    failed = false;
+    unsigned long steps = 0;
+    for (;;) {
+	word_type gp = in->GPR[GP];
+	word_type sp = in->GPR[SP];
+	word_type fp = in->GPR[FP];
+	if (!(0 <= gp && gp < sp && sp <= fp && fp < MEMORY_SIZE_IN_WORDS)) {
+	    fail(in, "Error: The VM's invariant does not hold!");
+	}
+	if (failed) {
+	    return finished;
+	}
+	turn_result r = execute(in);
+	steps++;
+	if (failed || r == finished || r == parked) {
+	    return failed ? finished : r;
+	}
+	if (r == turn_over && steps >= GREEN_THREADS_QUANTUM) {
+	    return turn_over;
+	}
+    }
+}
+
+// Start a session on the connection fd, adding its instance to w
+static void start_session(worker *w, int fd)
+{
+    instance *in = (instance *) calloc(1, sizeof(instance));
+    int out_fd = dup(fd);
+    if (in == NULL || out_fd < 0) {
+	close(fd);
+	free(in);
+	return;
+    }
+    in->mem = (word_type *) malloc(sizeof(memory.words));
+    in->out = fdopen(out_fd, "w");
+    if (in->mem == NULL || in->out == NULL) {
+	close(fd);
+	close(out_fd);
+	free(in->mem);
+	free(in);
+	return;
+    }
+    in->fd = fd;
+    memcpy(in->mem, memory.words, sizeof(memory.words));
+    memcpy(in->GPR, initial_GPR, sizeof(initial_GPR));
+    in->PC = initial_PC;
+    if (w->num_instances == w->capacity) {
+	w->capacity = 2 * w->capacity + 16;
+	w->instances = (instance **) realloc(w->instances,
+					     w->capacity * sizeof(instance *));
+	if (w->instances == NULL) {
+	    bail_with_error("Cannot allocate space for the sessions!");
+	}
+    }
+    w->instances[w->num_instances++] = in;
+}
+
+// End the session of the instance, freeing it
+static void end_session(instance *in)
+{
+    fclose(in->out);
+    close(in->fd);
+    free(in->mem);
+    free(in);
+}
+
+// Wait for (up to timeout ms, or forever if it is -1) and handle
+// new connections and input for the parked instances of w
+static void poll_events(worker *w, int timeout)
+{
+    int num_fds = 1;
+    struct pollfd *fds = (struct pollfd *)
+	malloc((w->num_instances + 1) * sizeof(struct pollfd));
+    if (fds == NULL) {
+	bail_with_error("Cannot allocate space for the sessions!");
+    }
+    fds[0].fd = w->listen_fd;
+    fds[0].events = POLLIN;
+    for (int i = 0; i < w->num_instances; i++) {
+	// (instances that are not parked are left out by using fd -1)
+	fds[num_fds].fd = w->instances[i]->is_parked ? w->instances[i]->fd : -1;
+	fds[num_fds].events = POLLIN;
+	num_fds++;
+    }
+    if (poll(fds, num_fds, timeout) > 0) {
+	for (int i = 0; i < w->num_instances; i++) {
+	    if (fds[i + 1].revents != 0) {
+		w->instances[i]->is_parked = false;
+	    }
+	}
+	if (fds[0].revents & POLLIN) {
+	    // (another worker may have accepted the connection already)
+	    int fd = accept(w->listen_fd, NULL, NULL);
+	    if (fd >= 0) {
+		start_session(w, fd);
+	    }
+	}
+    }
+    free(fds);
+}
+
+// Run the sessions of the worker (a worker *) forever
+static void *run_worker(void *arg)
+{
+    worker *w = (worker *) arg;
+    for (;;) {
+	bool any_ready = false;
+	for (int i = 0; i < w->num_instances; i++) {
+	    any_ready = any_ready || !w->instances[i]->is_parked;
+	}
+	poll_events(w, any_ready ? 0 : -1);
+	// give each instance that is not parked a turn
+	int kept = 0;
+	for (int i = 0; i < w->num_instances; i++) {
+	    instance *in = w->instances[i];
+	    if (!in->is_parked) {
+		turn_result r = run_turn(in);
+		fflush(in->out);
+		if (r == finished) {
+		    end_session(in);
+		    continue;
+		}
+		in->is_parked = (r == parked);
+	    }
+	    w->instances[kept++] = in;
+	}
+	w->num_instances = kept;
+    }
+    return NULL;
+}
+
+// Requires: a program has been loaded (with machine_load) but not run.
+// Listen on the Unix-domain socket at socket_path, and run a new
+// instance of the program for each connection to it, which reads its
+// input from and writes its output to that connection
+// (tracing is not done, so STRA and NOTR do nothing).
+// The instances run on num_workers threads; this does not return.
+void green_threads_serve(const char *socket_path, int num_workers)
+{
+    memcpy(initial_GPR, GPR, sizeof(initial_GPR));
+    initial_PC = PC;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+	bail_with_error("Socket path is too long: %s", socket_path);
+    }
+    strcpy(addr.sun_path, socket_path);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);
+    if (listen_fd < 0
+	|| bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+	|| listen(listen_fd, LISTEN_BACKLOG) != 0) {
+	bail_with_error("Cannot listen on %s", socket_path);
+    }
+    // so workers that lose the race for a connection do not block
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+    // a session that closes its connection should not stop the VM
+    signal(SIGPIPE, SIG_IGN);
+
+    worker *workers = (worker *) calloc(num_workers, sizeof(worker));
+    if (workers == NULL) {
+	bail_with_error("Cannot allocate space for the workers!");
+    }
+    for (int i = 0; i < num_workers; i++) {
+	workers[i].listen_fd = listen_fd;
+	if (i > 0) {
+	    pthread_t thread;
+	    if (pthread_create(&thread, NULL, run_worker, &workers[i]) != 0) {
+		bail_with_error("Cannot create a worker thread!");
+	    }
+	}
+    }
+    run_worker(&workers[0]);
+}
+
+#else  // no sockets or poll
+
+// Sessions are not available without sockets
+void green_threads_serve(const char *socket_path, int num_workers)
+{
+    bail_with_error("Serving sessions is not supported on this system");
+}
+
+#endif
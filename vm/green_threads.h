@@ -0,0 +1,20 @@
+// Serving many interactive sessions of the loaded program,
+// each one an instance of the VM run as a green thread:
+// the instances are time-sliced on a few worker threads,
+// and instances waiting for input do not run until it arrives
+#ifndef _GREEN_THREADS_H
+#define _GREEN_THREADS_H
+
+// the fewest instructions an instance runs before another one can run
+// (it can be preempted at the next backward branch or jump after these)
+#define GREEN_THREADS_QUANTUM 10000
+
+// Requires: a program has been loaded (with machine_load) but not run.
+// Listen on the Unix-domain socket at socket_path, and run a new
+// instance of the program for each connection to it, which reads its
+// input from and writes its output to that connection
+// (tracing is not done, so STRA and NOTR do nothing).
+// The instances run on num_workers threads; this does not return.
+extern void green_threads_serve(const char *socket_path, int num_workers);
+
+#endif
@@ -8,8 +8,6 @@
 #include "machine_types.h"
 #include "asm.tab.h"
 
-#define INSTR_BUF_SIZE 512
-
 // the following declaration isn't in <string.h> everywhere ...
 extern char *strdup(const char *s);
 
@@ -25,9 +23,10 @@ instr_type instruction_type(bin_instr_t i) {
     case OTHC_O:
 	if (i.othc.func == SYS_F) {
 	    return syscall_instr_type;
+	} else if (i.othc.func == NOP_F) {
+	    // (not a valid instruction, which the caller reports)
+	    return error_instr_type;
 	} else {
-	    assert(i.othc.op != COMP_O);
-	    assert(i.othc.func != NOP_F);
 	    return other_comp_instr_type;
 	}
 	break;
@@ -255,31 +254,38 @@ const char *instruction_mnemonic(bin_instr_t bi) {
     return NULL;  // should never happen
 }
 
-static char address_comment_buf[512];
-
-// return a comment string of the form
-// "# target is word address %u"
-// that uses the formAddress function to get the proper address
-static const char *instruction_formAddress_comment(address_type addr,
-						   address_type a)
+// return the address of the end of buf, a comment of the form
+// "# target is word address %u" that uses the formAddress function
+// to get the proper address, written into buf
+static char *instruction_formAddress_comment(char *buf, address_type addr,
+					     address_type a)
 {
     address_type actual = machine_types_formAddress(addr, a);
-    sprintf(address_comment_buf, "# target is word address %u",
-	    actual);
-    return strdup(address_comment_buf);
+    return buf + sprintf(buf, "# target is word address %u", actual);
 }
 
 
 // Return a string containing the assembly language form of instr,
 // which is found at address addr
+// (the string is overwritten by the next call)
 const char *instruction_assembly_form(address_type addr,
 				      bin_instr_t instr)
 {
-    char *buf = instr_buf;
+    return instruction_assembly_form_into(instr_buf, addr, instr);
+}
+
+// Requires: buf has room for INSTR_BUF_SIZE chars
+// Write the assembly language form of instr, which is found at address addr,
+// into buf and return buf.
+// This uses no static storage, so it can be called from several threads.
+const char *instruction_assembly_form_into(char *buf, address_type addr,
+					   bin_instr_t instr)
+{
+    char *ret = buf;
 
     // put in the mnemonic for the instruction
     int cwr = sprintf(buf, "%s ", instruction_mnemonic(instr));
-    // point buf to the null char that was printed into instr_buf
+    // point buf to the null char that was printed into ret
     buf += cwr;
 
     instr_type it = instruction_type(instr);
@@ -342,9 +348,8 @@ const char *instruction_assembly_form(address_type addr,
 		    instr.othc.offset, instr.othc.arg);
 	    break;
 	case JREL_F:
-	    sprintf(buf, "%hd\t%s", instr.othc.arg,
-		    instruction_formAddress_comment(addr,
-						    addr+instr.othc.arg));
+	    buf += sprintf(buf, "%hd\t", instr.othc.arg);
+	    instruction_formAddress_comment(buf, addr, addr+instr.othc.arg);
 	    break;  
 	default:
 	    bail_with_error("Unknown other computational instruction function (%d)!",
@@ -364,10 +369,10 @@ const char *instruction_assembly_form(address_type addr,
 	    break;
 	case BEQ_O: case BGEZ_O: case BGTZ_O:
 	case BLEZ_O: case BLTZ_O: case BNE_O:
-	    sprintf(buf, "%s, %hd, %hd\t%s", regname_get(instr.immed.reg),
-		    instr.immed.offset, instr.immed.immed,
-		    instruction_formAddress_comment(addr,
-						    addr+instr.immed.immed));
+	    buf += sprintf(buf, "%s, %hd, %hd\t", regname_get(instr.immed.reg),
+			   instr.immed.offset, instr.immed.immed);
+	    instruction_formAddress_comment(buf, addr,
+					    addr+instr.immed.immed);
 	    break;
 	default:
 	    bail_with_error("Unknown immediate type instruction opcode (%d)!",
@@ -378,8 +383,8 @@ const char *instruction_assembly_form(address_type addr,
     case jump_instr_type:
 	switch (instr.jump.op) {
 	case JMPA_O: case CALL_O:
-	    sprintf(buf, "%u\t%s", instr.jump.addr,
-		    instruction_formAddress_comment(addr, instr.jump.addr));
+	    buf += sprintf(buf, "%u\t", instr.jump.addr);
+	    instruction_formAddress_comment(buf, addr, instr.jump.addr);
 	    break;
 	case RTN_O:
 	    // no arguments in this case
@@ -411,7 +416,7 @@ const char *instruction_assembly_form(address_type addr,
 	break;
     }
 
-    return instr_buf;
+    return ret;
 }
 
 // Requires: out is open and writable FILE
@@ -145,11 +145,23 @@ extern void instruction_write_jumpInstr(BOFFILE bf, jump_instr_t ji);
 // Return the assembly language name (mnemonic) for bi
 extern const char *instruction_mnemonic(bin_instr_t bi);
 
+// size of the buffers that hold one instruction's assembly language form
+#define INSTR_BUF_SIZE 512
+
 // Return a string containing the assembly language form of instr,
 // which is found at address addr
+// (the string is overwritten by the next call)
 extern const char *instruction_assembly_form(address_type addr,
 					     bin_instr_t instr);
 
+// Requires: buf has room for INSTR_BUF_SIZE chars
+// Write the assembly language form of instr, which is found at address addr,
+// into buf and return buf.
+// This uses no static storage, so it can be called from several threads.
+extern const char *instruction_assembly_form_into(char *buf,
+						  address_type addr,
+						  bin_instr_t instr);
+
 // Requires: out is open and writable FILE
 // print the header of the instruction output table on out
 extern void instruction_print_table_heading(FILE *out);
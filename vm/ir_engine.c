@@ -0,0 +1,733 @@
+// An execution engine for the VM that translates basic blocks of
+// the loaded program into a register-based intermediate representation
+// (IR) and interprets that, instead of decoding each instruction as it runs.
+//
+// Code for the stack machine spends many of its instructions moving SP
+// (with ARI and SRI) and storing temporaries near the top of the stack.
+// Within a block SP is kept symbolic: its changes are folded into
+// the displacements of the operands that use it and SP is only updated
+// once, at the end of the block (or before a system call).
+// Stores that are overwritten later in the same block, before anything
+// could read them, are removed.  So the memory the guest can see
+// is the same as with the switch engine at every block boundary.
+//
+// The machine's invariant (see machine_okay) is checked once, on entry
+// to a block, for all the values SP takes in that block; when that check
+// fails the caller runs the switch engine instead, so that the same
+// assertion fails at the same instruction.
+#include <stdlib.h>
+#include <stdbool.h>
+#include "machine_types.h"
+#include "machine.h"
+#include "machine_state.h"
+#include "instruction.h"
+#include "regname.h"
+#include "ir_engine.h"
+#include "coverage.h"
+#include "utilities.h"
+
+// the most guest instructions translated into one block
+#define MAX_BLOCK_INSTRS 256
+
+// operations of the IR
+typedef enum {
+    // operations that write the memory word at [t+ot]
+    ir_add, ir_sub, ir_cpw, ir_and, ir_bor, ir_nor, ir_xor,
+    ir_swr, ir_sca, ir_lwi, ir_neg, ir_lit, ir_cfhi, ir_cflo,
+    ir_sll, ir_srl, ir_addi, ir_andi, ir_bori, ir_nori, ir_xori,
+    // operations that write the register t
+    ir_cpr, ir_lwr, ir_ari,
+    // operations that write HI and LO
+    ir_mul, ir_div,
+    // add imm to SP (making its symbolic value real)
+    ir_adjust_sp,
+    // operations that end a block
+    ir_beq, ir_bne, ir_bgez, ir_bgtz, ir_blez, ir_bltz,
+    ir_jump, ir_call, ir_rtn, ir_jmp, ir_csi,
+    ir_guest,     // execute the guest instruction bi with the switch engine
+    ir_continue   // go on to the instruction at target
+} ir_op;
+
+// An IR instruction.  An operand is the memory word at the address
+// GPR[base] + displacement; when the base is SP, the displacement
+// includes SP's symbolic offset at that point in the block.
+typedef struct {
+    ir_op op;
+    reg_num_type t;       // base register of the target (or only) operand
+    word_type ot;         // displacement of the target operand
+    reg_num_type s;       // base register of the source operand
+    word_type os;         // displacement of the source operand
+    word_type sp;         // displacement of the implicit operand at SP
+    word_type imm;        // immediate, shift amount or register adjustment
+    word_type delta;      // SP's symbolic offset at this instruction
+    address_type addr;    // the address of the guest instruction
+    address_type target;  // the target of a branch or jump
+    bin_instr_t bi;       // the guest instruction (for ir_guest)
+} ir_instr;
+
+// A translated basic block
+typedef struct {
+    // the range of SP's symbolic offsets in the block,
+    // for checking the invariant on entry
+    word_type min_delta;
+    word_type max_delta;
+    unsigned int length;
+    ir_instr code[];
+} ir_block;
+
+// blocks[a] is the translation of the block starting at a (or NULL)
+static ir_block *blocks[MEMORY_SIZE_IN_WORDS];
+// no block starts at or above translated_limit
+static address_type translated_limit = 0;
+
+// the state of a block being translated
+typedef struct {
+    // the code, with room for an SP adjustment and an end
+    ir_instr code[MAX_BLOCK_INSTRS + 2];
+    unsigned int length;
+    word_type delta;   // SP's current symbolic offset
+    word_type min_delta;
+    word_type max_delta;
+} translation;
+
+// Add an instruction with the given op, for the guest instruction
+// bi at address addr, to the end of tr's code and return it
+static ir_instr *emit(translation *tr, ir_op op, address_type addr,
+		      bin_instr_t bi)
+{
+    ir_instr *ii = &tr->code[tr->length++];
+    ii->op = op;
+    ii->t = ii->s = 0;
+    ii->ot = ii->os = ii->imm = ii->target = 0;
+    ii->sp = ii->delta = tr->delta;
+    ii->addr = addr;
+    ii->bi = bi;
+    return ii;
+}
+
+// Return the displacement for an operand with the given base register
+// and offset, at the current point in tr
+static word_type disp(const translation *tr, reg_num_type reg, word_type off)
+{
+    return reg == SP ? off + tr->delta : off;
+}
+
+// Make the value of SP real (before the instruction at addr)
+static void materialize_sp(translation *tr, address_type addr)
+{
+    if (tr->delta != 0) {
+	emit(tr, ir_adjust_sp, addr, memory.instrs[addr])->imm = tr->delta;
+	tr->delta = 0;
+    }
+}
+
+// Set the operands of ii (for memory operations of the comp format)
+static void comp_operands(translation *tr, ir_instr *ii, comp_instr_t ci)
+{
+    ii->t = ci.rt;
+    ii->ot = disp(tr, ci.rt, machine_types_formOffset(ci.ot));
+    ii->s = ci.rs;
+    ii->os = disp(tr, ci.rs, machine_types_formOffset(ci.os));
+}
+
+// Set the target operand of ii to [reg+offset]
+static void target_operand(translation *tr, ir_instr *ii,
+			   reg_num_type reg, offset_type offset)
+{
+    ii->t = reg;
+    ii->ot = disp(tr, reg, machine_types_formOffset(offset));
+}
+
+// Is reg one that the machine's invariant depends on?
+static bool is_frame_reg(reg_num_type reg)
+{
+    return reg == GP || reg == SP || reg == FP;
+}
+
+// Translate the computational instruction bi at addr into tr.
+// Return true if it must end the block (as it writes GP, SP or FP).
+static bool translate_comp(translation *tr, address_type addr, bin_instr_t bi)
+{
+    static const ir_op mem_ops[] = {
+	[ADD_F] = ir_add, [SUB_F] = ir_sub, [CPW_F] = ir_cpw,
+	[AND_F] = ir_and, [BOR_F] = ir_bor, [NOR_F] = ir_nor,
+	[XOR_F] = ir_xor, [SCA_F] = ir_sca, [LWI_F] = ir_lwi,
+	[NEG_F] = ir_neg
+    };
+    comp_instr_t ci = bi.comp;
+    ir_instr *ii;
+    switch (ci.func) {
+    case NOP_F:
+	return false;
+    case ADD_F: case SUB_F: case CPW_F: case AND_F: case BOR_F:
+    case NOR_F: case XOR_F: case SCA_F: case LWI_F: case NEG_F:
+	comp_operands(tr, emit(tr, mem_ops[ci.func], addr, bi), ci);
+	return false;
+    case SWR_F:
+	ii = emit(tr, ir_swr, addr, bi);
+	comp_operands(tr, ii, ci);
+	ii->imm = disp(tr, ci.rs, 0);
+	return false;
+    case CPR_F: case LWR_F:
+	ii = emit(tr, ci.func == CPR_F ? ir_cpr : ir_lwr, addr, bi);
+	comp_operands(tr, ii, ci);
+	ii->t = ci.rt;
+	ii->imm = disp(tr, ci.rs, 0);
+	if (ci.rt == SP) {
+	    // SP's old value (and symbolic offset) no longer matter
+	    tr->delta = 0;
+	}
+	return is_frame_reg(ci.rt);
+    default:
+	// invalid, so let the switch engine report it
+	materialize_sp(tr, addr);
+	emit(tr, ir_guest, addr, bi);
+	return true;
+    }
+}
+
+// Translate the other computational instruction bi at addr into tr.
+// Return true if it ends the block.
+static bool translate_othc(translation *tr, address_type addr, bin_instr_t bi)
+{
+    other_comp_instr_t oci = bi.othc;
+    ir_instr *ii;
+    switch (oci.func) {
+    case LIT_F:
+	ii = emit(tr, ir_lit, addr, bi);
+	target_operand(tr, ii, oci.reg, oci.offset);
+	ii->imm = machine_types_sgnExt(oci.arg);
+	return false;
+    case ARI_F: case SRI_F:
+	{
+	    word_type change = oci.func == ARI_F
+		? machine_types_sgnExt(oci.arg)
+		: - machine_types_sgnExt(oci.arg);
+	    if (oci.reg == SP) {
+		tr->delta += change;
+		return false;
+	    }
+	    ii = emit(tr, ir_ari, addr, bi);
+	    ii->t = oci.reg;
+	    ii->imm = change;
+	    return is_frame_reg(oci.reg);
+	}
+    case MUL_F: case DIV_F: case CFHI_F: case CFLO_F:
+    case SLL_F: case SRL_F:
+	{
+	    static const ir_op ops[] = {
+		[MUL_F] = ir_mul, [DIV_F] = ir_div, [CFHI_F] = ir_cfhi,
+		[CFLO_F] = ir_cflo, [SLL_F] = ir_sll, [SRL_F] = ir_srl
+	    };
+	    ii = emit(tr, ops[oci.func], addr, bi);
+	    target_operand(tr, ii, oci.reg, oci.offset);
+	    ii->imm = oci.arg;
+	    return false;
+	}
+    case JMP_F: case CSI_F:
+	materialize_sp(tr, addr);
+	ii = emit(tr, oci.func == JMP_F ? ir_jmp : ir_csi, addr, bi);
+	target_operand(tr, ii, oci.reg, oci.offset);
+	return true;
+    case JREL_F:
+	materialize_sp(tr, addr);
+	emit(tr, ir_jump, addr, bi)->target
+	    = addr + machine_types_formOffset(oci.arg);
+	return true;
+    default:
+	// system calls (and invalid instructions) use the switch engine
+	materialize_sp(tr, addr);
+	emit(tr, ir_guest, addr, bi);
+	return true;
+    }
+}
+
+// Translate the instruction with an immediate operand bi at addr into tr.
+// Return true if it ends the block.
+static bool translate_immed(translation *tr, address_type addr,
+			    bin_instr_t bi)
+{
+    static const ir_op ops[] = {
+	[ADDI_O] = ir_addi, [ANDI_O] = ir_andi, [BORI_O] = ir_bori,
+	[NORI_O] = ir_nori, [XORI_O] = ir_xori,
+	[BEQ_O] = ir_beq, [BGEZ_O] = ir_bgez, [BGTZ_O] = ir_bgtz,
+	[BLEZ_O] = ir_blez, [BLTZ_O] = ir_bltz, [BNE_O] = ir_bne
+    };
+    immed_instr_t im = bi.immed;
+    bool is_branch = im.op >= BEQ_O;
+    if (is_branch) {
+	materialize_sp(tr, addr);
+    }
+    ir_instr *ii = emit(tr, ops[im.op], addr, bi);
+    target_operand(tr, ii, im.reg, im.offset);
+    if (is_branch) {
+	ii->target = addr + machine_types_formOffset(im.immed);
+    } else if (im.op == ADDI_O) {
+	ii->imm = machine_types_sgnExt(im.immed);
+    } else {
+	ii->imm = machine_types_zeroExt(bi.uimmed.uimmed);
+    }
+    return is_branch;
+}
+
+// Requires: ii->op writes memory
+// Set regs and disps to the memory operands that ii reads
+// and return how many there are (or -1 if it could read any word)
+static int operands_read(const ir_instr *ii, reg_num_type regs[2],
+			 word_type disps[2])
+{
+    switch (ii->op) {
+    case ir_add: case ir_sub: case ir_and: case ir_bor:
+    case ir_nor: case ir_xor:
+	regs[0] = SP;
+	disps[0] = ii->sp;
+	regs[1] = ii->s;
+	disps[1] = ii->os;
+	return 2;
+    case ir_mul: case ir_div:
+	regs[0] = SP;
+	disps[0] = ii->sp;
+	regs[1] = ii->t;
+	disps[1] = ii->ot;
+	return 2;
+    case ir_cpw: case ir_neg: case ir_lwr:
+	regs[0] = ii->s;
+	disps[0] = ii->os;
+	return 1;
+    case ir_sll: case ir_srl:
+	regs[0] = SP;
+	disps[0] = ii->sp;
+	return 1;
+    case ir_addi: case ir_andi: case ir_bori: case ir_nori: case ir_xori:
+	regs[0] = ii->t;
+	disps[0] = ii->ot;
+	return 1;
+    case ir_lwi:
+	return -1;
+    default:  // swr, sca, lit, cfhi, cflo, cpr, and ari read no memory
+	return 0;
+    }
+}
+
+// Does ii write the memory word at its target operand?
+static bool writes_memory(const ir_instr *ii)
+{
+    return ii->op <= ir_xori;
+}
+
+// Does ii only change registers, HI, LO, or memory
+// (so that it does not end a block)?
+static bool is_straight_line(const ir_instr *ii)
+{
+    return ii->op < ir_adjust_sp;
+}
+
+// Requires: code[i] writes memory
+// Is the store by code[i] overwritten later in the block,
+// without possibly being read first?
+static bool is_dead_store(const ir_instr code[], unsigned int i,
+			  unsigned int length)
+{
+    const ir_instr *st = &code[i];
+    for (unsigned int j = i + 1; j < length; j++) {
+	const ir_instr *ii = &code[j];
+	if (!is_straight_line(ii)) {
+	    return false;
+	}
+	reg_num_type regs[2];
+	word_type disps[2];
+	int n = operands_read(ii, regs, disps);
+	if (n < 0) {
+	    return false;
+	}
+	for (int k = 0; k < n; k++) {
+	    // a read through another base register may be of the same word
+	    if (regs[k] != st->t || disps[k] == st->ot) {
+		return false;
+	    }
+	}
+	if ((ii->op == ir_cpr || ii->op == ir_lwr || ii->op == ir_ari)
+	    && ii->t == st->t) {
+	    return false;
+	}
+	if (writes_memory(ii) && ii->t == st->t && ii->ot == st->ot) {
+	    return true;
+	}
+    }
+    return false;
+}
+
+// Remove the stores in tr's code that are overwritten before being read
+static void remove_dead_stores(translation *tr)
+{
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < tr->length; i++) {
+	if (!(writes_memory(&tr->code[i])
+	      && is_dead_store(tr->code, i, tr->length))) {
+	    tr->code[kept++] = tr->code[i];
+	}
+    }
+    tr->length = kept;
+}
+
+// Requires: start < instruction_words
+// Translate the basic block starting at the word address start
+// and return the translation
+static ir_block *translate(address_type start)
+{
+    static translation tr;
+    tr.length = 0;
+    tr.delta = tr.min_delta = tr.max_delta = 0;
+    address_type addr = start;
+    unsigned int count = 0;
+    bool done = false;
+    while (!done) {
+	// SP's value when the switch engine checks the invariant
+	tr.min_delta = tr.delta < tr.min_delta ? tr.delta : tr.min_delta;
+	tr.max_delta = tr.delta > tr.max_delta ? tr.delta : tr.max_delta;
+	bin_instr_t bi = memory.instrs[addr];
+	switch (bi.comp.op) {
+	case COMP_O:
+	    done = translate_comp(&tr, addr, bi);
+	    break;
+	case OTHC_O:
+	    done = translate_othc(&tr, addr, bi);
+	    break;
+	case JMPA_O: case CALL_O:
+	    materialize_sp(&tr, addr);
+	    emit(&tr, bi.jump.op == JMPA_O ? ir_jump : ir_call, addr, bi)
+		->target = machine_types_formAddress(addr, bi.jump.addr);
+	    done = true;
+	    break;
+	case RTN_O:
+	    materialize_sp(&tr, addr);
+	    emit(&tr, ir_rtn, addr, bi);
+	    done = true;
+	    break;
+	default:
+	    done = translate_immed(&tr, addr, bi);
+	    break;
+	}
+	addr++;
+	count++;
+	bool at_end = tr.length > 0 && !is_straight_line(&tr.code[tr.length-1]);
+	if (!at_end
+	    && (done || count == MAX_BLOCK_INSTRS || addr >= instruction_words)) {
+	    materialize_sp(&tr, addr);
+	    emit(&tr, ir_continue, addr, memory.instrs[addr])->target = addr;
+	    done = true;
+	}
+    }
+    remove_dead_stores(&tr);
+
+    ir_block *ret = (ir_block *) malloc(sizeof(ir_block)
+					+ tr.length * sizeof(ir_instr));
+    if (ret == NULL) {
+	bail_with_error("Cannot allocate space for an IR block!");
+    }
+    ret->min_delta = tr.min_delta;
+    ret->max_delta = tr.max_delta;
+    ret->length = tr.length;
+    for (unsigned int i = 0; i < tr.length; i++) {
+	ret->code[i] = tr.code[i];
+    }
+    if (start >= translated_limit) {
+	translated_limit = start + 1;
+    }
+    return ret;
+}
+
+// Forget all translated blocks
+// (needed when the program's instructions are changed)
+void ir_engine_flush()
+{
+    for (address_type a = 0; a < translated_limit; a++) {
+	free(blocks[a]);
+	blocks[a] = NULL;
+    }
+    translated_limit = 0;
+}
+
+// Requires: a program has been loaded into the machine's memory
+// Forget any previous translations and translate the basic blocks
+// reachable (through fall throughs, branches and direct jumps)
+// from the word address entry
+void ir_engine_load(address_type entry)
+{
+    static address_type worklist[MEMORY_SIZE_IN_WORDS];
+    int pending = 0;
+    ir_engine_flush();
+    if (entry < instruction_words) {
+	blocks[entry] = translate(entry);
+	worklist[pending++] = entry;
+    }
+    while (pending > 0) {
+	const ir_block *b = blocks[worklist[--pending]];
+	const ir_instr *last = &b->code[b->length - 1];
+	address_type next[2] = { last->addr + 1, last->target };
+	int num_next = 0;
+	switch (last->op) {
+	case ir_beq: case ir_bne: case ir_bgez: case ir_bgtz:
+	case ir_blez: case ir_bltz: case ir_call:
+	    num_next = 2;
+	    break;
+	case ir_jump: case ir_continue:
+	    next[0] = last->target;
+	    num_next = 1;
+	    break;
+	case ir_guest: case ir_csi:
+	    num_next = 1;
+	    break;
+	default: // the targets of rtn and jmp are only known when running
+	    break;
+	}
+	for (int i = 0; i < num_next; i++) {
+	    if (next[i] < instruction_words && blocks[next[i]] == NULL) {
+		blocks[next[i]] = translate(next[i]);
+		worklist[pending++] = next[i];
+	    }
+	}
+    }
+}
+
+// Is the machine's invariant true for all the values of SP in b?
+static bool entry_okay(const ir_block *b)
+{
+    return 0 <= GPR[GP] && GPR[GP] < GPR[SP] + b->min_delta
+	&& GPR[SP] + b->max_delta <= GPR[FP]
+	&& GPR[FP] < MEMORY_SIZE_IN_WORDS;
+}
+
+// Return the address of ii's target operand, marking its page as dirty
+static inline address_type target_address(const ir_instr *ii)
+{
+    address_type wa = GPR[ii->t] + ii->ot;
+    mem_mark_dirty(wa);
+    return wa;
+}
+
+// Return the memory word at ii's source operand
+static inline word_type source_word(const ir_instr *ii)
+{
+    return memory.words[GPR[ii->s] + ii->os];
+}
+
+// Return the memory word at ii's implicit operand at SP
+static inline word_type sp_word(const ir_instr *ii)
+{
+    return memory.words[GPR[SP] + ii->sp];
+}
+
+// the result of run_block when the block did not end with a branch or jump
+#define NOT_A_BRANCH MEMORY_SIZE_IN_WORDS
+
+// Requires: the invariant holds for all values of SP in b
+// Run the block b, leaving PC at the next instruction to execute.
+// Returns the address of the branch or jump that ended the block
+// (or NOT_A_BRANCH if it did not end with one)
+static address_type run_block(const ir_block *b)
+{
+    for (const ir_instr *ii = b->code; ; ii++) {
+	address_type wa = NO_WORD_WRITTEN;
+	switch (ii->op) {
+	case ir_add:
+	    wa = target_address(ii);
+	    memory.words[wa] = sp_word(ii) + source_word(ii);
+	    break;
+	case ir_sub:
+	    wa = target_address(ii);
+	    memory.words[wa] = sp_word(ii) - source_word(ii);
+	    break;
+	case ir_cpw:
+	    wa = target_address(ii);
+	    memory.words[wa] = source_word(ii);
+	    break;
+	case ir_and:
+	    wa = target_address(ii);
+	    memory.uwords[wa] = (uword_type) sp_word(ii)
+		& (uword_type) source_word(ii);
+	    break;
+	case ir_bor:
+	    wa = target_address(ii);
+	    memory.uwords[wa] = (uword_type) sp_word(ii)
+		| (uword_type) source_word(ii);
+	    break;
+	case ir_nor:
+	    wa = target_address(ii);
+	    memory.uwords[wa] = ~((uword_type) sp_word(ii)
+				  | (uword_type) source_word(ii));
+	    break;
+	case ir_xor:
+	    wa = target_address(ii);
+	    memory.uwords[wa] = (uword_type) sp_word(ii)
+		^ (uword_type) source_word(ii);
+	    break;
+	case ir_swr:
+	    wa = target_address(ii);
+	    memory.words[wa] = GPR[ii->s] + ii->imm;
+	    break;
+	case ir_sca:
+	    wa = target_address(ii);
+	    memory.words[wa] = GPR[ii->s] + ii->os;
+	    break;
+	case ir_lwi:
+	    {
+		word_type v = memory.words[source_word(ii)];
+		wa = target_address(ii);
+		memory.words[wa] = v;
+	    }
+	    break;
+	case ir_neg:
+	    wa = target_address(ii);
+	    memory.words[wa] = - source_word(ii);
+	    break;
+	case ir_lit:
+	    wa = target_address(ii);
+	    memory.words[wa] = ii->imm;
+	    break;
+	case ir_cfhi:
+	    wa = target_address(ii);
+	    memory.words[wa] = hilo_regs.hilo[HI];
+	    break;
+	case ir_cflo:
+	    wa = target_address(ii);
+	    memory.words[wa] = hilo_regs.hilo[LO];
+	    break;
+	case ir_sll:
+	    wa = target_address(ii);
+	    memory.uwords[wa] = (uword_type) sp_word(ii) << ii->imm;
+	    break;
+	case ir_srl:
+	    wa = target_address(ii);
+	    memory.uwords[wa] = (uword_type) sp_word(ii) >> ii->imm;
+	    break;
+	case ir_addi:
+	    wa = target_address(ii);
+	    memory.words[wa] = memory.words[wa] + ii->imm;
+	    break;
+	case ir_andi:
+	    wa = target_address(ii);
+	    memory.uwords[wa] = memory.uwords[wa] & (uword_type) ii->imm;
+	    break;
+	case ir_bori:
+	    wa = target_address(ii);
+	    memory.uwords[wa] = memory.uwords[wa] | (uword_type) ii->imm;
+	    break;
+	case ir_nori:
+	    wa = target_address(ii);
+	    memory.uwords[wa] = ~(memory.uwords[wa] | (uword_type) ii->imm);
+	    break;
+	case ir_xori:
+	    wa = target_address(ii);
+	    memory.uwords[wa] = memory.uwords[wa] ^ (uword_type) ii->imm;
+	    break;
+	case ir_cpr:
+	    GPR[ii->t] = GPR[ii->s] + ii->imm;
+	    break;
+	case ir_lwr:
+	    GPR[ii->t] = source_word(ii);
+	    break;
+	case ir_ari:
+	    GPR[ii->t] = GPR[ii->t] + ii->imm;
+	    break;
+	case ir_mul:
+	    hilo_regs.result = (long) sp_word(ii)
+		* (long) memory.words[GPR[ii->t] + ii->ot];
+	    break;
+	case ir_div:
+	    {
+		word_type divisor = memory.words[GPR[ii->t] + ii->ot];
+		if (divisor == 0) {
+		    bail_with_error("Error: Attempt to divide by zero!");
+		}
+		machine_types_divide(sp_word(ii), divisor,
+				     &hilo_regs.hilo[LO], &hilo_regs.hilo[HI]);
+	    }
+	    break;
+	case ir_adjust_sp:
+	    GPR[SP] = GPR[SP] + ii->imm;
+	    break;
+	case ir_beq:
+	    PC = memory.words[GPR[SP]] == memory.words[GPR[ii->t] + ii->ot]
+		? ii->target : ii->addr + 1;
+	    return ii->addr;
+	case ir_bne:
+	    PC = memory.words[GPR[SP]] != memory.words[GPR[ii->t] + ii->ot]
+		? ii->target : ii->addr + 1;
+	    return ii->addr;
+	case ir_bgez:
+	    PC = memory.words[GPR[ii->t] + ii->ot] >= 0
+		? ii->target : ii->addr + 1;
+	    return ii->addr;
+	case ir_bgtz:
+	    PC = memory.words[GPR[ii->t] + ii->ot] > 0
+		? ii->target : ii->addr + 1;
+	    return ii->addr;
+	case ir_blez:
+	    PC = memory.words[GPR[ii->t] + ii->ot] <= 0
+		? ii->target : ii->addr + 1;
+	    return ii->addr;
+	case ir_bltz:
+	    PC = memory.words[GPR[ii->t] + ii->ot] < 0
+		? ii->target : ii->addr + 1;
+	    return ii->addr;
+	case ir_jump:
+	    PC = ii->target;
+	    return ii->addr;
+	case ir_call:
+	    GPR[RA] = ii->addr + 1;
+	    PC = ii->target;
+	    return ii->addr;
+	case ir_rtn:
+	    PC = GPR[RA];
+	    return ii->addr;
+	case ir_jmp:
+	    PC = memory.uwords[GPR[ii->t] + ii->ot];
+	    return ii->addr;
+	case ir_csi:
+	    GPR[RA] = ii->addr + 1;
+	    PC = memory.words[GPR[ii->t] + ii->ot];
+	    return ii->addr;
+	case ir_guest:
+	    PC = ii->addr;
+	    last_written = NO_WORD_WRITTEN;
+	    machine_trace_execute_instr(stdout, ii->addr, ii->bi);
+	    if (last_written < instruction_words) {
+		ir_engine_flush();
+	    }
+	    return NOT_A_BRANCH;
+	case ir_continue:
+	    PC = ii->target;
+	    return NOT_A_BRANCH;
+	}
+	if (wa < instruction_words) {
+	    // the program changed its own instructions,
+	    // so leave the block (which may now be wrong) right away
+	    GPR[SP] = GPR[SP] + ii->delta;
+	    PC = ii->addr + 1;
+	    ir_engine_flush();
+	    return NOT_A_BRANCH;
+	}
+    }
+}
+
+// Requires: a program has been loaded and ir_engine_load was called.
+// Run the program with translated blocks, starting at PC,
+// until it stops running, tracing is turned on, or the next block
+// could not be run exactly as the switch engine would
+// (then the caller should execute at least one instruction itself)
+void ir_engine_run()
+{
+    while (running && !tracing && PC < instruction_words) {
+	if (blocks[PC] == NULL) {
+	    blocks[PC] = translate(PC);
+	}
+	if (!entry_okay(blocks[PC])) {
+	    return;
+	}
+	address_type from = run_block(blocks[PC]);
+	if (coverage_on && from != NOT_A_BRANCH) {
+	    coverage_edge(from, PC);
+	}
+    }
+}
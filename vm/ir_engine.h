@@ -0,0 +1,25 @@
+// An execution engine for the VM that translates basic blocks of
+// the loaded program into a register-based intermediate representation
+// (in which SP is tracked symbolically) and interprets that instead
+#ifndef _IR_ENGINE_H
+#define _IR_ENGINE_H
+#include "machine_types.h"
+
+// Requires: a program has been loaded into the machine's memory
+// Forget any previous translations and translate the basic blocks
+// reachable (through fall throughs, branches and direct jumps)
+// from the word address entry
+extern void ir_engine_load(address_type entry);
+
+// Forget all translated blocks
+// (needed when the program's instructions are changed)
+extern void ir_engine_flush();
+
+// Requires: a program has been loaded and ir_engine_load was called.
+// Run the program with translated blocks, starting at PC,
+// until it stops running, tracing is turned on, or the next block
+// could not be run exactly as the switch engine would
+// (then the caller should execute at least one instruction itself)
+extern void ir_engine_run();
+
+#endif
@@ -0,0 +1,641 @@
+// Running several instances of the loaded program in lockstep,
+// each reading a different input.
+// The instances' memories are interleaved (lane_memory[wa][lane]),
+// so an instruction that all the instances execute with the same
+// addresses works on LOCKSTEP_LANES adjacent words
+// (loops that the compiler can turn into SIMD instructions).
+// Each step runs the instances whose PC is the smallest PC
+// of any running instance (and whose instruction there is the same),
+// so instances that split at a branch rejoin where their paths meet.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "machine_types.h"
+#include "machine_state.h"
+#include "instruction.h"
+#include "lockstep.h"
+#include "utilities.h"
+
+// a set of lanes, with bit l set for lane l
+typedef unsigned int lane_mask;
+
+// the interleaved memories of the instances
+static word_type lane_memory[MEMORY_SIZE_IN_WORDS][LOCKSTEP_LANES];
+// the registers of the instances, lane_GPR[r][lane]
+static word_type lane_GPR[NUM_REGISTERS][LOCKSTEP_LANES];
+
+// the rest of the state of one instance
+typedef struct {
+    const char *input_name;
+    FILE *in;
+    FILE *out;
+    address_type PC;
+    union longAs2words_u hilo_regs;
+    int exit_code;
+    bool failed;   // did the instance stop with an error?
+} lane_state;
+
+static lane_state lanes[LOCKSTEP_LANES];
+// the lanes that are still running
+static lane_mask running_lanes;
+
+// where words read or written outside the memory go,
+// after their instance is stopped
+static word_type scratch_word;
+
+// statistics for the report
+static unsigned long steps;
+static unsigned long lane_instructions;
+
+// Stop the instance in lane l with an error, reporting msg on stderr
+static void lane_fail(int l, const char *msg)
+{
+    if (running_lanes & (1u << l)) {
+	fprintf(stderr, "%s: %s\n", lanes[l].input_name, msg);
+	lanes[l].failed = true;
+	lanes[l].exit_code = EXIT_FAILURE;
+	running_lanes &= ~(1u << l);
+    }
+}
+
+// Return a pointer to the word at address wa in the memory of lane l
+// (stopping that instance if wa is not in the memory)
+static inline word_type *word_at(int l, address_type wa)
+{
+    if (wa >= MEMORY_SIZE_IN_WORDS) {
+	lane_fail(l, "Error: Address is outside the VM's memory!");
+	return &scratch_word;
+    }
+    return &lane_memory[wa][l];
+}
+
+// Return a pointer to the word at GPR[r] + offset in the memory of lane l
+static inline word_type *reg_word(int l, reg_num_type r, word_type offset)
+{
+    return word_at(l, lane_GPR[r][l] + offset);
+}
+
+// Return true if register r has the same value in all the lanes
+static bool uniform(reg_num_type r)
+{
+    for (int l = 1; l < LOCKSTEP_LANES; l++) {
+	if (lane_GPR[r][l] != lane_GPR[r][0]) {
+	    return false;
+	}
+    }
+    return true;
+}
+
+// Print the null-terminated string at word address wa in lane l's memory
+// on its output, returning the number of chars printed
+static int print_lane_string(int l, address_type wa)
+{
+    int count = 0;
+    for (; wa < MEMORY_SIZE_IN_WORDS; wa++) {
+	char bytes[BYTES_PER_WORD];
+	memcpy(bytes, &lane_memory[wa][l], BYTES_PER_WORD);
+	for (int b = 0; b < BYTES_PER_WORD; b++) {
+	    if (bytes[b] == '\0') {
+		return count;
+	    }
+	    fputc(bytes[b], lanes[l].out);
+	    count++;
+	}
+    }
+    return count;
+}
+
+// Return the instruction at word address wa in lane l's memory
+static bin_instr_t lane_instr(int l, address_type wa)
+{
+    bin_instr_t ret;
+    memcpy(&ret, &lane_memory[wa][l], sizeof(ret));
+    return ret;
+}
+
+// Requires: all the lanes are running.
+// Execute bi, which is at address addr, in all the lanes at once,
+// returning true, or return false if bi is not one that is done this way
+// (or the lanes' registers that it uses for addresses are not the same).
+static bool execute_all_lanes(address_type addr, bin_instr_t bi)
+{
+    if (!uniform(SP)) {
+	return false;
+    }
+    address_type sp = lane_GPR[SP][0];
+    if (bi.comp.op == COMP_O) {
+	comp_instr_t ci = bi.comp;
+	if (!uniform(ci.rt) || !uniform(ci.rs)) {
+	    return false;
+	}
+	address_type dst = lane_GPR[ci.rt][0] + machine_types_formOffset(ci.ot);
+	address_type src = lane_GPR[ci.rs][0] + machine_types_formOffset(ci.os);
+	if (dst >= MEMORY_SIZE_IN_WORDS || src >= MEMORY_SIZE_IN_WORDS
+	    || sp >= MEMORY_SIZE_IN_WORDS) {
+	    return false;
+	}
+	uword_type *d = (uword_type *) lane_memory[dst];
+	const uword_type *a = (const uword_type *) lane_memory[sp];
+	const uword_type *b = (const uword_type *) lane_memory[src];
+	uword_type result[LOCKSTEP_LANES];
+	switch (ci.func) {
+	case ADD_F:
+	    for (int l = 0; l < LOCKSTEP_LANES; l++) {
+		result[l] = a[l] + b[l];
+	    }
+	    break;
+	case SUB_F:
+	    for (int l = 0; l < LOCKSTEP_LANES; l++) {
+		result[l] = a[l] - b[l];
+	    }
+	    break;
+	case CPW_F:
+	    for (int l = 0; l < LOCKSTEP_LANES; l++) {
+		result[l] = b[l];
+	    }
+	    break;
+	default:
+	    return false;
+	}
+	memcpy(d, result, sizeof(result));
+	for (int l = 0; l < LOCKSTEP_LANES; l++) {
+	    lanes[l].PC = addr + 1;
+	}
+	return true;
+    }
+    if (bi.othc.op == OTHC_O) {
+	other_comp_instr_t oci = bi.othc;
+	word_type *reg = lane_GPR[oci.reg];
+	switch (oci.func) {
+	case ARI_F:
+	    for (int l = 0; l < LOCKSTEP_LANES; l++) {
+		reg[l] += machine_types_sgnExt(oci.arg);
+	    }
+	    break;
+	case SRI_F:
+	    for (int l = 0; l < LOCKSTEP_LANES; l++) {
+		reg[l] -= machine_types_sgnExt(oci.arg);
+	    }
+	    break;
+	default:
+	    return false;
+	}
+	for (int l = 0; l < LOCKSTEP_LANES; l++) {
+	    lanes[l].PC = addr + 1;
+	}
+	return true;
+    }
+    immed_instr_t ii = bi.immed;
+    if (ii.op == JMPA_O || ii.op == CALL_O || ii.op == RTN_O
+	|| !uniform(ii.reg)) {
+	return false;
+    }
+    address_type src = lane_GPR[ii.reg][0] + machine_types_formOffset(ii.offset);
+    if (src >= MEMORY_SIZE_IN_WORDS || sp >= MEMORY_SIZE_IN_WORDS) {
+	return false;
+    }
+    word_type *a = lane_memory[sp];
+    word_type *b = lane_memory[src];
+    address_type taken = addr + machine_types_formOffset(ii.immed);
+    bool cond[LOCKSTEP_LANES];
+    switch (ii.op) {
+    case ADDI_O:
+	for (int l = 0; l < LOCKSTEP_LANES; l++) {
+	    b[l] = (uword_type) b[l] + machine_types_sgnExt(ii.immed);
+	}
+	for (int l = 0; l < LOCKSTEP_LANES; l++) {
+	    lanes[l].PC = addr + 1;
+	}
+	return true;
+    case BEQ_O:
+	for (int l = 0; l < LOCKSTEP_LANES; l++) {
+	    cond[l] = a[l] == b[l];
+	}
+	break;
+    case BNE_O:
+	for (int l = 0; l < LOCKSTEP_LANES; l++) {
+	    cond[l] = a[l] != b[l];
+	}
+	break;
+    case BGEZ_O:
+	for (int l = 0; l < LOCKSTEP_LANES; l++) {
+	    cond[l] = b[l] >= 0;
+	}
+	break;
+    case BGTZ_O:
+	for (int l = 0; l < LOCKSTEP_LANES; l++) {
+	    cond[l] = b[l] > 0;
+	}
+	break;
+    case BLEZ_O:
+	for (int l = 0; l < LOCKSTEP_LANES; l++) {
+	    cond[l] = b[l] <= 0;
+	}
+	break;
+    case BLTZ_O:
+	for (int l = 0; l < LOCKSTEP_LANES; l++) {
+	    cond[l] = b[l] < 0;
+	}
+	break;
+    default:
+	return false;
+    }
+    for (int l = 0; l < LOCKSTEP_LANES; l++) {
+	lanes[l].PC = cond[l] ? taken : addr + 1;
+    }
+    return true;
+}
+
+// Execute the instruction bi, which is at address addr,
+// in the instance in lane l
+static void execute_lane(int l, address_type addr, bin_instr_t bi)
+{
+    lane_state *ls = &lanes[l];
+    word_type *gpr_sp = &lane_GPR[SP][l];
+    ls->PC = addr + 1;
+    switch (instruction_type(bi)) {
+    case comp_instr_type:
+	{
+	    comp_instr_t ci = bi.comp;
+	    word_type ot = machine_types_formOffset(ci.ot);
+	    word_type os = machine_types_formOffset(ci.os);
+	    switch (ci.func) {
+	    case NOP_F:
+		break;
+	    case ADD_F:
+		*reg_word(l, ci.rt, ot) = (uword_type) *word_at(l, *gpr_sp)
+		    + (uword_type) *reg_word(l, ci.rs, os);
+		break;
+	    case SUB_F:
+		*reg_word(l, ci.rt, ot) = (uword_type) *word_at(l, *gpr_sp)
+		    - (uword_type) *reg_word(l, ci.rs, os);
+		break;
+	    case CPW_F:
+		*reg_word(l, ci.rt, ot) = *reg_word(l, ci.rs, os);
+		break;
+	    case CPR_F:
+		lane_GPR[ci.rt][l] = lane_GPR[ci.rs][l];
+		break;
+	    case AND_F:
+		*reg_word(l, ci.rt, ot) = *word_at(l, *gpr_sp)
+		    & *reg_word(l, ci.rs, os);
+		break;
+	    case BOR_F:
+		*reg_word(l, ci.rt, ot) = *word_at(l, *gpr_sp)
+		    | *reg_word(l, ci.rs, os);
+		break;
+	    case NOR_F:
+		*reg_word(l, ci.rt, ot) = ~(*word_at(l, *gpr_sp)
+					    | *reg_word(l, ci.rs, os));
+		break;
+	    case XOR_F:
+		*reg_word(l, ci.rt, ot) = *word_at(l, *gpr_sp)
+		    ^ *reg_word(l, ci.rs, os);
+		break;
+	    case LWR_F:
+		lane_GPR[ci.rt][l] = *reg_word(l, ci.rs, os);
+		break;
+	    case SWR_F:
+		*reg_word(l, ci.rt, ot) = lane_GPR[ci.rs][l];
+		break;
+	    case SCA_F:
+		*reg_word(l, ci.rt, ot) = lane_GPR[ci.rs][l] + os;
+		break;
+	    case LWI_F:
+		*reg_word(l, ci.rt, ot) = *word_at(l, *reg_word(l, ci.rs, os));
+		break;
+	    case NEG_F:
+		*reg_word(l, ci.rt, ot) = - (uword_type) *reg_word(l, ci.rs, os);
+		break;
+	    default:
+		lane_fail(l, "Error: Invalid function code in a computational instruction!");
+		break;
+	    }
+	}
+	break;
+    case other_comp_instr_type:
+	{
+	    other_comp_instr_t oci = bi.othc;
+	    word_type off = machine_types_formOffset(oci.offset);
+	    switch (oci.func) {
+	    case LIT_F:
+		*reg_word(l, oci.reg, machine_types_sgnExt(oci.offset))
+		    = machine_types_sgnExt(oci.arg);
+		break;
+	    case ARI_F:
+		lane_GPR[oci.reg][l] += machine_types_sgnExt(oci.arg);
+		break;
+	    case SRI_F:
+		lane_GPR[oci.reg][l] -= machine_types_sgnExt(oci.arg);
+		break;
+	    case MUL_F:
+		ls->hilo_regs.result = (long) *word_at(l, *gpr_sp)
+		    * (long) *reg_word(l, oci.reg, off);
+		break;
+	    case DIV_F:
+		{
+		    word_type divisor = *reg_word(l, oci.reg, off);
+		    if (divisor == 0) {
+			lane_fail(l, "Error: Attempt to divide by zero!");
+			break;
+		    }
+		    machine_types_divide(*word_at(l, *gpr_sp), divisor,
+					 &ls->hilo_regs.hilo[LO],
+					 &ls->hilo_regs.hilo[HI]);
+		}
+		break;
+	    case CFHI_F:
+		*reg_word(l, oci.reg, off) = ls->hilo_regs.hilo[HI];
+		break;
+	    case CFLO_F:
+		*reg_word(l, oci.reg, off) = ls->hilo_regs.hilo[LO];
+		break;
+	    case SLL_F:
+		*reg_word(l, oci.reg, off)
+		    = (uword_type) *word_at(l, *gpr_sp) << oci.arg;
+		break;
+	    case SRL_F:
+		*reg_word(l, oci.reg, off)
+		    = (uword_type) *word_at(l, *gpr_sp) >> oci.arg;
+		break;
+	    case JMP_F:
+		ls->PC = *reg_word(l, oci.reg, off);
+		break;
+	    case CSI_F:
+		lane_GPR[RA][l] = ls->PC;
+		ls->PC = *reg_word(l, oci.reg, off);
+		break;
+	    case JREL_F:
+		ls->PC = addr + machine_types_formOffset(oci.arg);
+		break;
+	    default:
+		lane_fail(l, "Error: Invalid function code in an other computational instruction!");
+		break;
+	    }
+	}
+	break;
+    case syscall_instr_type:
+	{
+	    syscall_instr_t si = bi.syscall;
+	    word_type off = machine_types_formOffset(si.offset);
+	    switch (si.code) {
+	    case exit_sc:
+		ls->exit_code = machine_types_sgnExt(si.offset);
+		running_lanes &= ~(1u << l);
+		break;
+	    case print_str_sc:
+		{
+		    int count = print_lane_string(l, lane_GPR[si.reg][l] + off);
+		    *word_at(l, *gpr_sp) = count;
+		}
+		break;
+	    case print_int_sc:
+		*word_at(l, *gpr_sp)
+		    = fprintf(ls->out, "%d", *reg_word(l, si.reg, off));
+		break;
+	    case print_char_sc:
+		*word_at(l, *gpr_sp) = fputc(*reg_word(l, si.reg, off), ls->out);
+		break;
+	    case read_char_sc:
+		*reg_word(l, si.reg, off) = getc(ls->in);
+		break;
+	    case start_tracing_sc: case stop_tracing_sc:
+		// tracing is not done in lockstep
+		break;
+	    default:
+		lane_fail(l, "Error: Invalid system call!");
+		break;
+	    }
+	}
+	break;
+    case immed_instr_type:
+	{
+	    immed_instr_t ii = bi.immed;
+	    uimmed_instr_t ui = bi.uimmed;
+	    word_type off = machine_types_formOffset(ii.offset);
+	    address_type taken = addr + machine_types_formOffset(ii.immed);
+	    switch (ii.op) {
+	    case ADDI_O:
+		{
+		    word_type *w = reg_word(l, ii.reg, off);
+		    *w = (uword_type) *w + machine_types_sgnExt(ii.immed);
+		}
+		break;
+	    case ANDI_O:
+		*reg_word(l, ui.reg, off) &= machine_types_zeroExt(ui.uimmed);
+		break;
+	    case BORI_O:
+		*reg_word(l, ui.reg, off) |= machine_types_zeroExt(ui.uimmed);
+		break;
+	    case NORI_O:
+		{
+		    word_type *w = reg_word(l, ui.reg, off);
+		    *w = ~(*w | machine_types_zeroExt(ui.uimmed));
+		}
+		break;
+	    case XORI_O:
+		*reg_word(l, ui.reg, off) ^= machine_types_zeroExt(ui.uimmed);
+		break;
+	    case BEQ_O:
+		if (*word_at(l, *gpr_sp) == *reg_word(l, ii.reg, off)) {
+		    ls->PC = taken;
+		}
+		break;
+	    case BGEZ_O:
+		if (*reg_word(l, ii.reg, off) >= 0) {
+		    ls->PC = taken;
+		}
+		break;
+	    case BGTZ_O:
+		if (*reg_word(l, ii.reg, off) > 0) {
+		    ls->PC = taken;
+		}
+		break;
+	    case BLEZ_O:
+		if (*reg_word(l, ii.reg, off) <= 0) {
+		    ls->PC = taken;
+		}
+		break;
+	    case BLTZ_O:
+		if (*reg_word(l, ii.reg, off) < 0) {
+		    ls->PC = taken;
+		}
+		break;
+	    case BNE_O:
+		if (*word_at(l, *gpr_sp) != *reg_word(l, ii.reg, off)) {
+		    ls->PC = taken;
+		}
+		break;
+	    default:
+		lane_fail(l, "Error: Invalid opcode in an immediate instruction!");
+		break;
+	    }
+	}
+	break;
+    case jump_instr_type:
+	{
+	    jump_instr_t ji = bi.jump;
+	    switch (ji.op) {
+	    case JMPA_O:
+		ls->PC = machine_types_formAddress(addr, ji.addr);
+		break;
+	    case CALL_O:
+		lane_GPR[RA][l] = ls->PC;
+		ls->PC = machine_types_formAddress(addr, ji.addr);
+		break;
+	    case RTN_O:
+		ls->PC = lane_GPR[RA][l];
+		break;
+	    default:
+		lane_fail(l, "Error: Invalid opcode in a jump instruction!");
+		break;
+	    }
+	}
+	break;
+    default:
+	lane_fail(l, "Error: Invalid instruction type!");
+	break;
+    }
+}
+
+// Stop the instances in mask whose state breaks the VM's invariant
+// (which the VM checks with an assertion before each instruction)
+static void check_invariant(lane_mask mask)
+{
+    for (int l = 0; l < LOCKSTEP_LANES; l++) {
+	if (!(mask & (1u << l))) {
+	    continue;
+	}
+	word_type gp = lane_GPR[GP][l];
+	word_type sp = lane_GPR[SP][l];
+	word_type fp = lane_GPR[FP][l];
+	if (!(0 <= gp && gp < sp && sp <= fp && fp < MEMORY_SIZE_IN_WORDS)) {
+	    lane_fail(l, "Error: The VM's invariant does not hold!");
+	} else if (lanes[l].PC >= MEMORY_SIZE_IN_WORDS) {
+	    lane_fail(l, "Error: The PC is outside the VM's memory!");
+	}
+    }
+}
+
+// Run the instances in lanes [0, num_lanes) until they all stop
+static void run_lanes(int num_lanes)
+{
+    running_lanes = (num_lanes == LOCKSTEP_LANES)
+	? ~0u >> (sizeof(lane_mask) * 8 - LOCKSTEP_LANES)
+	: (1u << num_lanes) - 1;
+    lane_mask all_lanes = running_lanes;
+    // are all the running instances at the same PC?
+    bool together = true;
+    check_invariant(running_lanes);
+    while (running_lanes != 0) {
+	// find the lowest PC of any running instance
+	int leader = -1;
+	for (int l = 0; l < num_lanes; l++) {
+	    if ((running_lanes & (1u << l))
+		&& (leader < 0 || (!together && lanes[l].PC < lanes[leader].PC))) {
+		leader = l;
+	    }
+	}
+	address_type addr = lanes[leader].PC;
+	word_type instr_word = lane_memory[addr][leader];
+	// the group: the instances at addr with the same instruction there
+	lane_mask group = 0;
+	for (int l = 0; l < num_lanes; l++) {
+	    if ((running_lanes & (1u << l)) && lanes[l].PC == addr
+		&& lane_memory[addr][l] == instr_word) {
+		group |= 1u << l;
+	    }
+	}
+	bin_instr_t bi = lane_instr(leader, addr);
+	steps++;
+	if (group == all_lanes && num_lanes == LOCKSTEP_LANES
+	    && execute_all_lanes(addr, bi)) {
+	    lane_instructions += LOCKSTEP_LANES;
+	} else {
+	    for (int l = 0; l < num_lanes; l++) {
+		if (group & (1u << l)) {
+		    execute_lane(l, addr, bi);
+		    lane_instructions++;
+		}
+	    }
+	}
+	check_invariant(group & running_lanes);
+	together = true;
+	for (int l = 0; l < num_lanes; l++) {
+	    if ((running_lanes & (1u << l)) && lanes[l].PC != lanes[leader].PC) {
+		together = false;
+	    }
+	}
+    }
+}
+
+// Requires: a program has been loaded (with machine_load) but not run.
+// Run the loaded program once for each of the num_inputs files
+// named in input_names, with that file as its standard input
+// and its output going to a file named by the input's name followed
+// by ".out", running up to LOCKSTEP_LANES instances in lockstep.
+// (The instances cannot use tracing, so STRA and NOTR do nothing.)
+// Each run's exit code and a summary are printed on report.
+// Returns the number of runs that stopped with an error.
+int lockstep_run_all(FILE *report, int num_inputs, char *input_names[])
+{
+    int failures = 0;
+    steps = 0;
+    lane_instructions = 0;
+    for (int first = 0; first < num_inputs; first += LOCKSTEP_LANES) {
+	int num_lanes = num_inputs - first;
+	if (num_lanes > LOCKSTEP_LANES) {
+	    num_lanes = LOCKSTEP_LANES;
+	}
+	// start each instance from the loaded program
+	for (int wa = 0; wa < MEMORY_SIZE_IN_WORDS; wa++) {
+	    for (int l = 0; l < LOCKSTEP_LANES; l++) {
+		lane_memory[wa][l] = memory.words[wa];
+	    }
+	}
+	for (int r = 0; r < NUM_REGISTERS; r++) {
+	    for (int l = 0; l < LOCKSTEP_LANES; l++) {
+		lane_GPR[r][l] = GPR[r];
+	    }
+	}
+	for (int l = 0; l < num_lanes; l++) {
+	    lane_state *ls = &lanes[l];
+	    ls->input_name = input_names[first + l];
+	    ls->in = fopen(ls->input_name, "r");
+	    if (ls->in == NULL) {
+		bail_with_error("Cannot open %s", ls->input_name);
+	    }
+	    char *out_name = (char *) malloc(strlen(ls->input_name) + 5);
+	    if (out_name == NULL) {
+		bail_with_error("Cannot allocate space for a file name!");
+	    }
+	    sprintf(out_name, "%s.out", ls->input_name);
+	    ls->out = fopen(out_name, "w");
+	    if (ls->out == NULL) {
+		bail_with_error("Cannot open %s for writing", out_name);
+	    }
+	    free(out_name);
+	    ls->PC = PC;
+	    ls->hilo_regs.result = 0;
+	    ls->exit_code = 0;
+	    ls->failed = false;
+	}
+
+	run_lanes(num_lanes);
+
+	for (int l = 0; l < num_lanes; l++) {
+	    fclose(lanes[l].in);
+	    fclose(lanes[l].out);
+	    fprintf(report, "%s: exit code %d\n", lanes[l].input_name,
+		    lanes[l].exit_code);
+	    if (lanes[l].failed) {
+		failures++;
+	    }
+	}
+    }
+    fprintf(report, "%lu instructions executed in %lu lockstep steps"
+	    " (%.2f instances per step)\n", lane_instructions, steps,
+	    steps > 0 ? (double) lane_instructions / steps : 0.0);
+    return failures;
+}
@@ -0,0 +1,21 @@
+// Running several instances of the loaded program in lockstep,
+// each reading a different input
+#ifndef _LOCKSTEP_H
+#define _LOCKSTEP_H
+#include <stdio.h>
+
+// the most instances that run in lockstep
+#define LOCKSTEP_LANES 8
+
+// Requires: a program has been loaded (with machine_load) but not run.
+// Run the loaded program once for each of the num_inputs files
+// named in input_names, with that file as its standard input
+// and its output going to a file named by the input's name followed
+// by ".out", running up to LOCKSTEP_LANES instances in lockstep.
+// (The instances cannot use tracing, so STRA and NOTR do nothing.)
+// Each run's exit code and a summary are printed on report.
+// Returns the number of runs that stopped with an error.
+extern int lockstep_run_all(FILE *report, int num_inputs,
+			    char *input_names[]);
+
+#endif
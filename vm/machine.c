@@ -2,53 +2,92 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 #include "machine_types.h"
 #include "machine.h"
+#include "machine_state.h"
 #include "regname.h"
+#include "mem_profile.h"
+#include "ir_engine.h"
+#include "watchpoints.h"
+#include "coverage.h"
 #include "utilities.h"
 
 #define MAX_PRINT_WIDTH 59
 
 // the VM's memory, in signed and unsigned word and binary instruction views.
-static union mem_u {
-    word_type words[MEMORY_SIZE_IN_WORDS];
-    uword_type uwords[MEMORY_SIZE_IN_WORDS];
-    bin_instr_t instrs[MEMORY_SIZE_IN_WORDS];
-} memory;
+// (aligned so that its host pages can be protected for watchpoints)
+_Alignas(WATCHPOINT_PAGE_ALIGNMENT) union mem_u memory;
 
 // general purpose registers
-static word_type GPR[NUM_REGISTERS];
+word_type GPR[NUM_REGISTERS];
 // hi and lo registers used in multiplication and division.
-// A view as a (signed) long int (result, 64 bits)
-// and as an array (hilo) of 2 32-bit ints.
-static union longAs2words_u {
-    long result;
-    word_type hilo[2]; 
-} hilo_regs;
-
-// LO is index 0, HI is index 1, for an x86 architecture
-// (because the x86 is little-endian)
-#define LO 0
-#define HI 1
+union longAs2words_u hilo_regs;
 
 // the program counter
-static address_type PC;
+address_type PC;
 
 // should the machine be printing tracing output?
-static bool tracing;
+bool tracing;
+
+// should the machine record a profile of its memory accesses?
+static bool profiling;
+
+// the engine that machine_run uses
+static machine_engine engine = switch_engine;
 
 // initial_stack_bottom is used for tracing
 static address_type initial_stack_bottom;
 
 // words of instructions (based on the header)
-static unsigned short instruction_words;
+unsigned short instruction_words;
 // words of global data (based on the header)
 static unsigned short global_data_words;
+// the word address of the global data (based on the header)
+static address_type global_data_base;
 
 
 // should the machine be running? (default true)
-static bool running;
+// (volatile, as a watchpoint's fault handler can stop the machine)
+volatile bool running;
+
+// the exit code given by the program's EXIT instruction
+int exit_code;
+
+// dirty_pages[p] is true when page p has been written since the last reset
+bool dirty_pages[NUM_DIRTY_PAGES];
+// the page numbers of the dirty pages, in the order they were first written
+unsigned short dirty_page_list[NUM_DIRTY_PAGES];
+unsigned int num_dirty_pages;
+
+// When full_dump_interval is not 0, tracing prints only the registers
+// and memory words that changed in each step,
+// and prints the full state every full_dump_interval steps.
+static unsigned int full_dump_interval;
+// number of steps traced so far (to know when to print the full state)
+static unsigned long trace_steps;
+
+// the last word written and its old value (see machine_state.h)
+address_type last_written;
+word_type last_written_old;
+bool recording_writes;
+// the register values before the last instruction was executed
+static word_type prev_GPR[NUM_REGISTERS];
+static long prev_hilo;
+
+// Zero all the pages of memory written since the last reset
+// (the cost is proportional to the number of pages written)
+static void reset_dirty_memory()
+{
+    for (unsigned int i = 0; i < num_dirty_pages; i++) {
+	unsigned int page = dirty_page_list[i];
+	memset(&memory.words[page << DIRTY_PAGE_SHIFT], 0,
+	       DIRTY_PAGE_WORDS * sizeof(word_type));
+	dirty_pages[page] = false;
+    }
+    num_dirty_pages = 0;
+}
 
 // set up the state of the machine
 static void initialize()
@@ -57,16 +96,24 @@ static void initialize()
     instruction_words = 0;
     global_data_words = 0;
     running = true;
+    exit_code = 0;
+    trace_steps = 0;
 
     // zero the registers
     for (int j = 0; j < NUM_REGISTERS; j++) {
 	GPR[j] = 0;
     }
     hilo_regs.result = 0;
-    // zero out the memory
-    for (int i = 0; i < MEMORY_SIZE_IN_WORDS; i++) {
-	memory.words[i] = 0;
-    }
+    // zero out the memory left over from any previous run
+    watchpoints_clear();
+    reset_dirty_memory();
+}
+
+// Reset the machine to its initial state, so it can load another program.
+// Only the memory written since the last reset is zeroed.
+void machine_reset()
+{
+    initialize();
 }
 
 // Requires: bf is a binary object file that is open for reading
@@ -75,7 +122,7 @@ static void initialize()
 static void load_instructions(BOFFILE bf, int count)
 {
     for (int wa = 0; wa < count; wa++) {
-	memory.instrs[wa] = instruction_read(bf);
+	memory.instrs[mem_written(wa)] = instruction_read(bf);
     }
 }
 
@@ -86,7 +133,7 @@ static void load_instructions(BOFFILE bf, int count)
 static void load_data(BOFFILE bf, int count, unsigned int global_base)
 {
     for (int wo = 0; wo < count; wo++) {
-	memory.words[global_base+wo] = bof_read_word(bf);
+	memory.words[mem_written(global_base+wo)] = bof_read_word(bf);
     }
 }
 
@@ -98,13 +145,21 @@ void machine_load(BOFFILE bf)
 
     // read and check the header
     BOFHeader bh = bof_read_header(bf);
+    if (bh.text_length < 0 || bh.data_start_address < 0
+	|| bh.data_length < 0) {
+	bail_with_error("%s (%d), %s (%d), or %s (%d) is negative!",
+			"Text length", bh.text_length,
+			"global data start address", bh.data_start_address,
+			"global data length", bh.data_length);
+    }
     if (bh.text_length >= bh.data_start_address) {
 	bail_with_error("%s (%u) %s (%u)!",
 			"Text, i.e., program length", bh.text_length,
 			"is not less than the start address of the global data",
 			bh.data_start_address);
     }
-    if (bh.data_start_address + bh.data_length >= bh.stack_bottom_addr) {
+    if ((long) bh.data_start_address + bh.data_length
+	>= bh.stack_bottom_addr) {
 	bail_with_error("%s (%u) + %s (%u) %s (%u)!",
 			"Global data start address", bh.data_start_address,
 			"global data length", bh.data_length,
@@ -130,9 +185,22 @@ void machine_load(BOFFILE bf)
     PC = bh.text_start_address;
 
     GPR[GP] = bh.data_start_address;
+    global_data_base = bh.data_start_address;
     GPR[SP] = bh.stack_bottom_addr;
     GPR[FP] = bh.stack_bottom_addr;
     initial_stack_bottom = bh.stack_bottom_addr;
+
+    if (engine == ir_engine) {
+	ir_engine_load(PC);
+    }
+}
+
+// Requires: a program has been loaded into the computer's memory
+// Return the word address of the program's global data
+// (the initial value of GP)
+address_type machine_global_base()
+{
+    return global_data_base;
 }
 
 // Requires: fmt == 'x' or fmt == 'd'
@@ -235,26 +303,369 @@ void machine_print_loaded_program(FILE *out)
     print_global_data(out);
 }
 
+// Record the last word written (see machine_state.h) only when
+// the incremental trace, the memory profile or the IR engine needs it
+static void update_recording_writes()
+{
+    recording_writes = full_dump_interval != 0 || profiling
+	|| engine == ir_engine;
+}
+
+// Make tracing print only the registers and memory words that change
+// in each step, with the full state printed every interval steps
+// (if interval is 0, tracing prints the full state after every step)
+void machine_set_trace_diff(unsigned int interval)
+{
+    full_dump_interval = interval;
+    update_recording_writes();
+}
+
+// Make machine_run (and machine_load) use the engine e
+void machine_set_engine(machine_engine e)
+{
+    engine = e;
+    update_recording_writes();
+}
+
+// Make machine_run record a profile of the guest's memory accesses
+// (which can be printed with machine_print_profile)
+void machine_set_profiling(bool on)
+{
+    profiling = on;
+    update_recording_writes();
+}
+
+// Requires: the instruction bi is about to be executed
+// Record (in the memory profile) the words that bi will read
+static void profile_reads(bin_instr_t bi)
+{
+    switch (instruction_type(bi)) {
+    case comp_instr_type:
+	{
+	    comp_instr_t ci = bi.comp;
+	    address_type src = GPR[ci.rs] + machine_types_formOffset(ci.os);
+	    switch (ci.func) {
+	    case ADD_F: case SUB_F: case AND_F: case BOR_F:
+	    case NOR_F: case XOR_F:
+		mem_profile_read(GPR[SP]);
+		mem_profile_read(src);
+		break;
+	    case CPW_F: case LWR_F: case NEG_F:
+		mem_profile_read(src);
+		break;
+	    case LWI_F:
+		mem_profile_read(src);
+		mem_profile_read(memory.words[src]);
+		break;
+	    default: // NOP, CPR, SWR, and SCA do not read memory
+		break;
+	    }
+	}
+	break;
+    case other_comp_instr_type:
+	{
+	    other_comp_instr_t oci = bi.othc;
+	    address_type wa = GPR[oci.reg] + machine_types_formOffset(oci.offset);
+	    switch (oci.func) {
+	    case MUL_F: case DIV_F:
+		mem_profile_read(GPR[SP]);
+		mem_profile_read(wa);
+		break;
+	    case SLL_F: case SRL_F:
+		mem_profile_read(GPR[SP]);
+		break;
+	    case JMP_F: case CSI_F:
+		mem_profile_read(wa);
+		break;
+	    default: // LIT, ARI, SRI, CFHI, CFLO, and JREL do not read memory
+		break;
+	    }
+	}
+	break;
+    case syscall_instr_type:
+	{
+	    syscall_instr_t si = bi.syscall;
+	    address_type wa = GPR[si.reg] + machine_types_formOffset(si.offset);
+	    switch (si.code) {
+	    case print_str_sc:
+		{
+		    // the string's words, including the one with its null char
+		    size_t len = strlen((char *) &memory.words[wa]);
+		    for (size_t i = 0; i <= len / BYTES_PER_WORD; i++) {
+			mem_profile_read(wa + i);
+		    }
+		}
+		break;
+	    case print_int_sc: case print_char_sc:
+		mem_profile_read(wa);
+		break;
+	    default:
+		break;
+	    }
+	}
+	break;
+    case immed_instr_type:
+	{
+	    immed_instr_t ii = bi.immed;
+	    mem_profile_read(GPR[ii.reg] + machine_types_formOffset(ii.offset));
+	    if (ii.op == BEQ_O || ii.op == BNE_O) {
+		mem_profile_read(GPR[SP]);
+	    }
+	}
+	break;
+    default: // jump instructions do not read memory
+	break;
+    }
+}
+
+// Requires: the instruction at addr was just executed,
+// and last_written was set to NO_WORD_WRITTEN before it was.
+// Record the fetch of that instruction, the word it wrote (if any)
+// and the current SP in the memory profile.
+static void profile_after(address_type addr)
+{
+    mem_profile_fetch(addr);
+    if (last_written != NO_WORD_WRITTEN) {
+	mem_profile_write(last_written);
+    }
+    mem_profile_stack_pointer(GPR[SP]);
+}
+
+// Print the profile of the guest's memory accesses to out
+void machine_print_profile(FILE *out)
+{
+    mem_profile_print(out);
+}
+
+// did the machine stop because it executed a trap instruction?
+static bool trapped;
+// do trap instructions stop the machine? (only when the debugger runs it,
+// otherwise they are invalid instructions)
+static bool honoring_traps;
+
+// Execute instructions until the program exits or executes a trap
+// (going on after writes to watched pages, which stop the machine)
+static void run_until_stopped()
+{
+    address_type addr = PC;
+    do {
+	while (running) {
+	    if (engine == ir_engine && !tracing && !profiling
+		&& !watchpoints_active()) {
+		// run translated blocks for as long as they can be used
+		ir_engine_run();
+		if (!running) {
+		    break;
+		}
+	    }
+	    machine_okay(); // check the invariant
+	    addr = PC;
+	    if (profiling) {
+		profile_reads(memory.instrs[addr]);
+		last_written = NO_WORD_WRITTEN;
+		machine_trace_execute_instr(stdout, addr, memory.instrs[addr]);
+		profile_after(addr);
+	    } else {
+		machine_trace_execute_instr(stdout, addr, memory.instrs[addr]);
+	    }
+	    if (watchpoints_fault_pending) {
+		break;
+	    }
+	}
+    } while (watchpoints_resume(stderr, addr));
+}
+
 // Run the VM on the already loaded program,
-// producing any trace output called for by the program
-void machine_run(bool trace_execution)
+// producing any trace output called for by the program,
+// and return the exit code given by the program's EXIT instruction
+int machine_run(bool trace_execution)
 {
     tracing = trace_execution;
     if (tracing) {
 	machine_print_state(stdout);
     }
+    if (profiling) {
+	mem_profile_start(instruction_words, GPR[GP], global_data_words,
+			  initial_stack_bottom);
+    }
     // execute the program
-    while (running) {
-	machine_okay(); // check the invariant
+    run_until_stopped();
+    return exit_code;
+}
+
+// Requires: a program has been loaded and has not exited.
+// Execute instructions from the current PC until the program exits
+// or executes a trap instruction (see MACHINE_TRAP_F).
+// Returns true if it stopped at a trap, with the PC at the trap's address
+bool machine_continue()
+{
+    trapped = false;
+    honoring_traps = true;
+    run_until_stopped();
+    honoring_traps = false;
+    if (trapped) {
+	// the program can go on after the trap
+	running = true;
+    }
+    return trapped;
+}
+
+// Is the word at offset o from the address in register r in the memory?
+// (registers are signed, so the address may be negative)
+static bool operand_in_memory(reg_num_type r, offset_type o)
+{
+    long wa = (long) GPR[r] + machine_types_formOffset(o);
+    return 0 <= wa && wa < MEMORY_SIZE_IN_WORDS;
+}
+
+// Requires: the machine's invariant holds (so the word at SP is in memory)
+// Are all the words that bi would read or write in the memory?
+// (used to stop bounded runs of untrusted programs
+// before they index outside the memory)
+static bool accesses_in_memory(bin_instr_t bi)
+{
+    switch (instruction_type(bi)) {
+    case comp_instr_type:
+	{
+	    comp_instr_t ci = bi.comp;
+	    switch (ci.func) {
+	    case ADD_F: case SUB_F: case AND_F: case BOR_F:
+	    case NOR_F: case XOR_F: case CPW_F: case NEG_F:
+		return operand_in_memory(ci.rs, ci.os)
+		    && operand_in_memory(ci.rt, ci.ot);
+	    case LWR_F:
+		return operand_in_memory(ci.rs, ci.os);
+	    case SWR_F: case SCA_F:
+		return operand_in_memory(ci.rt, ci.ot);
+	    case LWI_F:
+		if (!operand_in_memory(ci.rs, ci.os)
+		    || !operand_in_memory(ci.rt, ci.ot)) {
+		    return false;
+		}
+		word_type wa = memory.words[GPR[ci.rs]
+					    + machine_types_formOffset(ci.os)];
+		return 0 <= wa && wa < MEMORY_SIZE_IN_WORDS;
+	    default: // NOP and CPR do not use memory
+		return true;
+	    }
+	}
+    case other_comp_instr_type:
+	{
+	    other_comp_instr_t oci = bi.othc;
+	    switch (oci.func) {
+	    case ARI_F: case SRI_F: case JREL_F: case MACHINE_TRAP_F:
+		return true;
+	    default:
+		return operand_in_memory(oci.reg, oci.offset);
+	    }
+	}
+    case syscall_instr_type:
+	{
+	    syscall_instr_t si = bi.syscall;
+	    switch (si.code) {
+	    case print_str_sc:
+		if (!operand_in_memory(si.reg, si.offset)) {
+		    return false;
+		}
+		// the string must end (with a null char) inside the memory
+		address_type wa = GPR[si.reg] + machine_types_formOffset(si.offset);
+		return memchr(&memory.words[wa], '\0',
+			      (MEMORY_SIZE_IN_WORDS - wa) * BYTES_PER_WORD)
+		    != NULL;
+	    case print_int_sc: case print_char_sc: case read_char_sc:
+		return operand_in_memory(si.reg, si.offset);
+	    default:
+		return true;
+	    }
+	}
+    case immed_instr_type:
+	return operand_in_memory(bi.immed.reg, bi.immed.offset);
+    default: // jump instructions do not use memory
+	return true;
+    }
+}
+
+// Requires: a program has been loaded.
+// Run the program without tracing for at most max_steps instructions,
+// stopping early (instead of failing an assertion or indexing outside
+// the host's memory) if the invariant does not hold, the PC is outside
+// the memory, or the next instruction would use a word outside the memory.
+// Returns true if the program exited.
+bool machine_run_bounded(unsigned long max_steps)
+{
+    tracing = false;
+    for (unsigned long i = 0; i < max_steps && running; i++) {
+	if (!machine_invariant_holds() || PC >= MEMORY_SIZE_IN_WORDS
+	    || !accesses_in_memory(memory.instrs[PC])) {
+	    return false;
+	}
 	machine_trace_execute_instr(stdout, PC, memory.instrs[PC]);
     }
+    return !running;
+}
+
+// Requires: a program has been loaded and has not exited.
+// Execute the one instruction at the PC.
+// Returns true if the program is still running.
+bool machine_step()
+{
+    address_type addr = PC;
+    machine_okay();
+    machine_trace_execute_instr(stdout, addr, memory.instrs[addr]);
+    watchpoints_resume(stderr, addr);
+    return running;
+}
+
+// Return the name of the dispatch engine that machine_run uses
+const char *machine_engine_name()
+{
+    return engine == ir_engine ? "ir" : "switch";
 }
 
-// Load the given binary object file and run it
-void machine_load_and_run(BOFFILE bf, bool trace_execution)
+// Load the given binary object file and run it,
+// returning the program's exit code
+int machine_load_and_run(BOFFILE bf, bool trace_execution)
 {
     machine_load(bf);
-    machine_run(trace_execution);
+    return machine_run(trace_execution);
+}
+
+// Remember the registers (and note that no memory was written yet),
+// so that print_state_changes can tell what the next instruction changed
+static void save_state_for_changes()
+{
+    for (int j = 0; j < NUM_REGISTERS; j++) {
+	prev_GPR[j] = GPR[j];
+    }
+    prev_hilo = hilo_regs.result;
+    last_written = NO_WORD_WRITTEN;
+}
+
+// Requires: save_state_for_changes() was called
+//           before executing the instruction at addr.
+// Print (on one line) the PC, if the instruction did not just go on
+// to the next one, and the registers and memory word
+// that the instruction changed.
+static void print_state_changes(FILE *out, address_type addr)
+{
+    if (PC != addr + 1) {
+	fprintf(out, "%8s: %u\t", "PC", PC);
+    }
+    if (hilo_regs.result != prev_hilo) {
+	fprintf(out, "%8s: %d\t%8s: %d\t",
+		"HI", hilo_regs.hilo[HI],
+		"LO", hilo_regs.hilo[LO]);
+    }
+    for (int j = 0; j < NUM_REGISTERS; j++) {
+	if (GPR[j] != prev_GPR[j]) {
+	    fprintf(out, "GPR[%s]: %d\t", regname_get(j), GPR[j]);
+	}
+    }
+    if (last_written != NO_WORD_WRITTEN
+	&& memory.words[last_written] != last_written_old) {
+	print_loc(out, last_written, 'd');
+    }
+    newline(out);
 }
 
 // Requires: addr == PC.
@@ -269,10 +680,35 @@ void machine_trace_execute_instr(FILE *out, address_type addr,
     if (tracing) {
 	fprintf(out, "\n==> ");
 	print_instruction(out, PC, bi);
+	if (full_dump_interval != 0) {
+	    save_state_for_changes();
+	}
     }
     machine_execute_instr(addr, bi);
-    if (tracing) {
-	machine_print_state(out);
+    if (tracing && running) {
+	if (full_dump_interval != 0
+	    && ++trace_steps % full_dump_interval != 0) {
+	    print_state_changes(out, addr);
+	} else {
+	    machine_print_state(out);
+	}
+    }
+}
+
+// Record the edge from the branch or jump at addr to the PC
+// (if coverage is being collected)
+static inline void cover_edge(address_type addr)
+{
+    if (coverage_on) {
+	coverage_edge(addr, PC);
+    }
+}
+
+// Report an error if a word cannot be shifted by amount bits
+static inline void check_shift(arg_type amount)
+{
+    if (amount < 0 || amount >= BYTES_PER_WORD * 8) {
+	bail_with_error("Invalid shift amount (%d)!", amount);
     }
 }
 
@@ -295,18 +731,18 @@ void machine_execute_instr(address_type addr, bin_instr_t bi)
 		// do nothing
 		break;
 	    case ADD_F:
-		memory.words[GPR[ci.rt] + machine_types_formOffset(ci.ot)]
+		memory.words[mem_written(GPR[ci.rt] + machine_types_formOffset(ci.ot))]
 		    = memory.words[GPR[SP]]
 			  + memory.words[GPR[ci.rs] + machine_types_formOffset(ci.os)];
 		break;
 	    case SUB_F:
-		memory.words[GPR[ci.rt] + machine_types_formOffset(ci.ot)]
+		memory.words[mem_written(GPR[ci.rt] + machine_types_formOffset(ci.ot))]
 		    = memory.words[GPR[SP]]
 		    - memory.words[GPR[ci.rs]
 				   + machine_types_formOffset(ci.os)];
 		break;
 	    case CPW_F:
-		memory.words[GPR[ci.rt] + machine_types_formOffset(ci.ot)]
+		memory.words[mem_written(GPR[ci.rt] + machine_types_formOffset(ci.ot))]
 		    = memory.words[GPR[ci.rs]
 				   + machine_types_formOffset(ci.os)];
 		break;
@@ -314,25 +750,25 @@ void machine_execute_instr(address_type addr, bin_instr_t bi)
 		GPR[ci.rt] = GPR[ci.rs];
 		break;
 	    case AND_F:
-		memory.uwords[GPR[ci.rt] + machine_types_formOffset(ci.ot)]
+		memory.uwords[mem_written(GPR[ci.rt] + machine_types_formOffset(ci.ot))]
 		    = memory.uwords[GPR[SP]]
 		    & memory.uwords[GPR[ci.rs]
 				    + machine_types_formOffset(ci.os)];
 		break;
 	    case BOR_F:
-		memory.uwords[GPR[ci.rt] + machine_types_formOffset(ci.ot)]
+		memory.uwords[mem_written(GPR[ci.rt] + machine_types_formOffset(ci.ot))]
 		    = memory.uwords[GPR[SP]]
 		    | memory.uwords[GPR[ci.rs]
 				    + machine_types_formOffset(ci.os)];
 		break;
 	    case NOR_F:
-		memory.uwords[GPR[ci.rt] + machine_types_formOffset(ci.ot)]
+		memory.uwords[mem_written(GPR[ci.rt] + machine_types_formOffset(ci.ot))]
 		    = ~(memory.uwords[GPR[SP]]
 			| memory.uwords[GPR[ci.rs]
 					+ machine_types_formOffset(ci.os)]);
 		break;
 	    case XOR_F:
-		memory.uwords[GPR[ci.rt] + machine_types_formOffset(ci.ot)]
+		memory.uwords[mem_written(GPR[ci.rt] + machine_types_formOffset(ci.ot))]
 		    = memory.uwords[GPR[SP]]
 		    ^ memory.uwords[GPR[ci.rs]
 				    + machine_types_formOffset(ci.os)];
@@ -343,21 +779,21 @@ void machine_execute_instr(address_type addr, bin_instr_t bi)
 				   + machine_types_formOffset(ci.os)];
 		break;
 	    case SWR_F:
-		memory.words[GPR[ci.rt]
-			     + machine_types_formOffset(ci.ot)]
+		memory.words[mem_written(GPR[ci.rt]
+			     + machine_types_formOffset(ci.ot))]
 		    = GPR[ci.rs];
 		break;
 	    case SCA_F:
-		memory.words[GPR[ci.rt] + machine_types_formOffset(ci.ot)]
+		memory.words[mem_written(GPR[ci.rt] + machine_types_formOffset(ci.ot))]
 		    = (GPR[ci.rs] + machine_types_formOffset(ci.os));
 		break;
 	    case LWI_F:
-		memory.words[GPR[ci.rt] + machine_types_formOffset(ci.ot)]
+		memory.words[mem_written(GPR[ci.rt] + machine_types_formOffset(ci.ot))]
 		    = memory.words[memory.words
 				   [GPR[ci.rs] + machine_types_formOffset(ci.os)]];
 		    break;
 	    case NEG_F:
-		memory.words[GPR[ci.rt] + machine_types_formOffset(ci.ot)]
+		memory.words[mem_written(GPR[ci.rt] + machine_types_formOffset(ci.ot))]
 		    = - (memory.words[GPR[ci.rs]
 				      + machine_types_formOffset(ci.os)]);
 		break;
@@ -373,7 +809,7 @@ void machine_execute_instr(address_type addr, bin_instr_t bi)
 	    other_comp_instr_t oci = bi.othc;
 	    switch (oci.func) {
 	    case LIT_F:
-		memory.words[GPR[oci.reg] + machine_types_sgnExt(oci.offset)]
+		memory.words[mem_written(GPR[oci.reg] + machine_types_sgnExt(oci.offset))]
 			     = machine_types_sgnExt(oci.arg);
 	        break;
 	    case ARI_F:
@@ -394,41 +830,56 @@ void machine_execute_instr(address_type addr, bin_instr_t bi)
 		if (divisor == 0) {
 		    bail_with_error("Error: Attempt to divide by zero!");
 		}
-		hilo_regs.hilo[HI] = memory.words[GPR[SP]] % divisor;
-		hilo_regs.hilo[LO] = memory.words[GPR[SP]] / divisor;
+		machine_types_divide(memory.words[GPR[SP]], divisor,
+				     &hilo_regs.hilo[LO], &hilo_regs.hilo[HI]);
 		break;
 	    case CFHI_F:
-		memory.words[GPR[oci.reg]
-				 + machine_types_formOffset(oci.offset)]
+		memory.words[mem_written(GPR[oci.reg]
+				 + machine_types_formOffset(oci.offset))]
 		    = hilo_regs.hilo[HI];
 		break;
 	    case CFLO_F:
-		memory.words[GPR[oci.reg]
-				 + machine_types_formOffset(oci.offset)]
+		memory.words[mem_written(GPR[oci.reg]
+				 + machine_types_formOffset(oci.offset))]
 		    = hilo_regs.hilo[LO];
 		break;
 	    case SLL_F:
-		memory.uwords[GPR[oci.reg]
-			     + machine_types_formOffset(oci.offset)]
+		check_shift(oci.arg);
+		memory.uwords[mem_written(GPR[oci.reg]
+			     + machine_types_formOffset(oci.offset))]
 		    = memory.uwords[GPR[SP]] << oci.arg;
 		break;
 	    case SRL_F:
-		memory.uwords[GPR[oci.reg]
-			     + machine_types_formOffset(oci.offset)]
+		check_shift(oci.arg);
+		memory.uwords[mem_written(GPR[oci.reg]
+			     + machine_types_formOffset(oci.offset))]
 		    = memory.uwords[GPR[SP]] >> oci.arg;
 		break;
 	    case JMP_F:
 		PC = memory.uwords[GPR[oci.reg]
 				   + machine_types_formOffset(oci.offset)];
+		cover_edge(addr);
 		break;
 	    case CSI_F:
 		GPR[RA] = PC;
 		PC = memory.words[GPR[oci.reg]
 				  + machine_types_formOffset(oci.offset)];
+		cover_edge(addr);
 		break;
 	    case JREL_F:
 		PC = (PC - 1) + machine_types_formOffset(oci.arg);
+		cover_edge(addr);
 		break;
+	    case MACHINE_TRAP_F:
+		if (honoring_traps) {
+		    // stop before the trap (for the debugger)
+		    PC = addr;
+		    trapped = true;
+		    running = false;
+		    break;
+		}
+		// otherwise it is an invalid function code
+		// fall through
 	    default:
 		bail_with_error("Invalid function code (%d) in machine_execute's OTHC_O computational instruction case!",
 				oci.func);
@@ -442,28 +893,28 @@ void machine_execute_instr(address_type addr, bin_instr_t bi)
 	    switch (si.code) {
 	    case exit_sc:
 		running = false;
-		exit(machine_types_sgnExt(si.offset));
+		exit_code = machine_types_sgnExt(si.offset);
 		break;
 	    case print_str_sc:
-		memory.words[GPR[SP]]
+		memory.words[mem_written(GPR[SP])]
 		    = printf("%s",
 			     (char *) &(memory.words[GPR[si.reg]
 						     + machine_types_formOffset(si.offset)]));
 		break;
 	    case print_int_sc:
-		memory.words[GPR[SP]]
+		memory.words[mem_written(GPR[SP])]
 		    = printf("%d",
 			     memory.words[GPR[si.reg]
 					  + machine_types_formOffset(si.offset)]);
 		break;
 	    case print_char_sc:
-		memory.words[GPR[SP]]
+		memory.words[mem_written(GPR[SP])]
 		    = fputc(memory.words[GPR[si.reg]
 					     + machine_types_formOffset(si.offset)],
 			    stdout);
 		break;
 	    case read_char_sc:
-		memory.words[GPR[si.reg] + machine_types_formOffset(si.offset)]
+		memory.words[mem_written(GPR[si.reg] + machine_types_formOffset(si.offset))]
 		    = getc(stdin);
 		break;
 	    case start_tracing_sc:
@@ -485,30 +936,30 @@ void machine_execute_instr(address_type addr, bin_instr_t bi)
 	    uimmed_instr_t ui = bi.uimmed;
 	    switch (ii.op) {
 	    case ADDI_O:
-		memory.words[GPR[ii.reg] + machine_types_formOffset(ii.offset)]
+		memory.words[mem_written(GPR[ii.reg] + machine_types_formOffset(ii.offset))]
 		    = memory.words[GPR[ii.reg] + machine_types_formOffset(ii.offset)]
 		      + machine_types_sgnExt(ii.immed);
 		break;
 	    case ANDI_O:
-		memory.uwords[GPR[ui.reg] + machine_types_formOffset(ui.offset)]
+		memory.uwords[mem_written(GPR[ui.reg] + machine_types_formOffset(ui.offset))]
 		    = memory.uwords[GPR[ui.reg]
 				    + machine_types_formOffset(ui.offset)]
 		      & machine_types_zeroExt(ui.uimmed);
 		break;
 	    case BORI_O:
-		memory.uwords[GPR[ui.reg] + machine_types_formOffset(ui.offset)]
+		memory.uwords[mem_written(GPR[ui.reg] + machine_types_formOffset(ui.offset))]
 		    = memory.uwords[GPR[ui.reg]
 				    + machine_types_formOffset(ui.offset)]
 		      | machine_types_zeroExt(ui.uimmed);
 		break;
 	    case NORI_O:
-		memory.uwords[GPR[ui.reg] + machine_types_formOffset(ui.offset)]
+		memory.uwords[mem_written(GPR[ui.reg] + machine_types_formOffset(ui.offset))]
 		    = ~(memory.uwords[GPR[ui.reg]
 				      + machine_types_formOffset(ui.offset)]
 			| machine_types_zeroExt(ui.uimmed));
 		break;
 	    case XORI_O:
-		memory.uwords[GPR[ui.reg] + machine_types_formOffset(ui.offset)]
+		memory.uwords[mem_written(GPR[ui.reg] + machine_types_formOffset(ui.offset))]
 		    = memory.uwords[GPR[ui.reg]
 				    + machine_types_formOffset(ui.offset)]
 		      ^ machine_types_zeroExt(ui.uimmed);
@@ -519,6 +970,7 @@ void machine_execute_instr(address_type addr, bin_instr_t bi)
 					+ machine_types_formOffset(ii.offset)]) {
 		    PC = (PC - 1) + machine_types_formOffset(ii.immed);
 		}
+		cover_edge(addr);
 		break;
 	    case BGEZ_O:
 		if (memory.words[GPR[ii.reg]
@@ -526,6 +978,7 @@ void machine_execute_instr(address_type addr, bin_instr_t bi)
 		    >= 0) {
 		    PC = (PC - 1) + machine_types_formOffset(ii.immed);
 		}
+		cover_edge(addr);
 		break;
 	    case BGTZ_O:
 		if (memory.words[GPR[ii.reg]
@@ -533,6 +986,7 @@ void machine_execute_instr(address_type addr, bin_instr_t bi)
 		    > 0) {
 		    PC = (PC - 1) + machine_types_formOffset(ii.immed);
 		}
+		cover_edge(addr);
 		break;
 	    case BLEZ_O:
 		if (memory.words[GPR[ii.reg]
@@ -540,6 +994,7 @@ void machine_execute_instr(address_type addr, bin_instr_t bi)
 		    <= 0) {
 		    PC = (PC - 1) + machine_types_formOffset(ii.immed);
 		}
+		cover_edge(addr);
 		break;
 	    case BLTZ_O:
 		if (memory.words[GPR[ii.reg]
@@ -547,6 +1002,7 @@ void machine_execute_instr(address_type addr, bin_instr_t bi)
 		    < 0) {
 		    PC = (PC - 1) + machine_types_formOffset(ii.immed);
 		}
+		cover_edge(addr);
 		break;
 	    case BNE_O:
 		if (memory.words[GPR[SP]]
@@ -554,6 +1010,7 @@ void machine_execute_instr(address_type addr, bin_instr_t bi)
 					+ machine_types_formOffset(ii.offset)]) {
 		    PC = (PC - 1) + machine_types_formOffset(ii.immed);
 		}
+		cover_edge(addr);
 		break;
 	    default:
 		bail_with_error("Invalid opcode (%d) in machine_execute's immediate instruction case!",
@@ -568,13 +1025,16 @@ void machine_execute_instr(address_type addr, bin_instr_t bi)
 	    switch (ji.op) {
 	    case JMPA_O:
 		PC = machine_types_formAddress(PC-1, ji.addr);
+		cover_edge(addr);
 		break;
 	    case CALL_O:
 		GPR[RA] = PC;
 		PC = machine_types_formAddress(PC-1, ji.addr);
+		cover_edge(addr);
 		break;
 	    case RTN_O:
 		PC = GPR[RA];
+		cover_edge(addr);
 		break;
 	    default:
 		bail_with_error("Invalid opcode (%d) in machine_execute's jump instruction case!",
@@ -638,6 +1098,13 @@ void machine_print_state(FILE *out)
     print_runtime_stack(out);
 }
 
+// Return true if the VM's invariant (checked by machine_okay) holds
+bool machine_invariant_holds()
+{
+    return 0 <= GPR[GP] && GPR[GP] < GPR[SP] && GPR[SP] <= GPR[FP]
+	&& GPR[FP] < MEMORY_SIZE_IN_WORDS;
+}
+
 // Invariant test for the VM (for debugging purposes)
 // This exits with an assertion error if the invariant does not pass
 void machine_okay()
@@ -9,21 +9,87 @@
 // a size for the memory (2^16 = 32K words)
 #define MEMORY_SIZE_IN_WORDS 32768
 
+// Reset the machine to its initial state, so it can load another program.
+// Only the memory written since the last reset is zeroed,
+// so the cost is proportional to the previous program's footprint.
+extern void machine_reset();
+
 // Requires: bf is open for reading in binary
 // Load the binary object file bf, and get ready to run it
+// (this resets the machine first)
 extern void machine_load(BOFFILE bf);
 
+// Requires: a program has been loaded into the computer's memory
+// Return the word address of the program's global data
+// (the initial value of GP)
+extern address_type machine_global_base();
+
 // Requires: a program has been loaded into the computer's memory
 // print a heading and the program in the VM's memory to out
 extern void machine_print_loaded_program(FILE *out);
 
+// Make tracing print only the registers and memory words that change
+// in each step, with the full state printed every interval steps
+// (if interval is 0, tracing prints the full state after every step)
+extern void machine_set_trace_diff(unsigned int interval);
+
+// the engines that machine_run can use to execute a program:
+// the switch engine decodes and executes one instruction at a time;
+// the IR engine translates basic blocks into a register-based form
+// (when the program is loaded) and runs those
+typedef enum { switch_engine, ir_engine } machine_engine;
+
+// Make machine_run (and machine_load) use the engine e
+// (the default is the switch engine;
+// tracing, profiling and watchpoints always use the switch engine)
+extern void machine_set_engine(machine_engine e);
+
+// Make machine_run record a profile of the guest's memory accesses
+// (which can be printed with machine_print_profile)
+extern void machine_set_profiling(bool on);
+
+// Print the profile of the guest's memory accesses
+// (reads and writes grouped into text, globals and stack,
+// and the stack's high-water mark) to out
+extern void machine_print_profile(FILE *out);
+
 // Run the VM on the already loaded program,
 // producing any trace output called for by the program
-// if trace_execution is true
-extern void machine_run(bool trace_execution);
+// if trace_execution is true.
+// Returns the exit code given by the program's EXIT instruction.
+extern int machine_run(bool trace_execution);
+
+// Return the name of the dispatch engine that machine_run uses
+extern const char *machine_engine_name();
+
+// the function code of the OTHC instruction that stops the machine
+// (it is not part of the SSM's instruction set; the debugger puts it
+// in place of an instruction to make a breakpoint, and it only stops
+// the machine in machine_continue, elsewhere it is an invalid instruction)
+#define MACHINE_TRAP_F 14
+
+// Requires: a program has been loaded and has not exited.
+// Execute instructions from the current PC until the program exits
+// or executes a trap instruction (see MACHINE_TRAP_F).
+// Returns true if it stopped at a trap, with the PC at the trap's address
+extern bool machine_continue();
 
-// Load the given binary object file and run it
-extern void machine_load_and_run(BOFFILE bf, bool trace_execution);
+// Requires: a program has been loaded.
+// Run the program without tracing for at most max_steps instructions,
+// stopping early (instead of failing an assertion or indexing outside
+// the host's memory) if the invariant does not hold, the PC is outside
+// the memory, or the next instruction would use a word outside the memory.
+// Returns true if the program exited.
+extern bool machine_run_bounded(unsigned long max_steps);
+
+// Requires: a program has been loaded and has not exited.
+// Execute the one instruction at the PC.
+// Returns true if the program is still running.
+extern bool machine_step();
+
+// Load the given binary object file and run it,
+// returning the program's exit code
+extern int machine_load_and_run(BOFFILE bf, bool trace_execution);
 
 // If tracing then print bi, execute bi (always),
 // then if tracing print out the machine's state.
@@ -43,6 +109,9 @@ extern void machine_trace_execute(FILE *out, bin_instr_t instr);
 // the memory between GPR[$sp] and GPR[$fp], inclusive) to out
 extern void machine_print_state(FILE *out);
 
+// Return true if the VM's invariant (checked by machine_okay) holds
+extern bool machine_invariant_holds();
+
 // Invariant test for the VM (for debugging purposes)
 // This exits with an assertion error if the invariant does not pass
 extern void machine_okay();
@@ -4,14 +4,45 @@
 #include <string.h>
 #include "bof.h"
 #include "machine.h"
+#include "perf_counters.h"
+#include "debugger.h"
+#include "watchpoints.h"
+#include "coverage.h"
+#include "lockstep.h"
+#include "run_cache.h"
+#include "green_threads.h"
+#include "fork_server.h"
 #include "utilities.h"
 
+// the most watchpoints that can be given with -w
+#define MAX_WATCHES 64
+
 /* Print a usage message on stderr and exit with exit code 1. */
 static void usage(const char *cmdname)
 {
     bail_with_error(
-		    "Usage: %s [-p] file.bof\n        %s [-t] file.bof",
-		    cmdname, cmdname);
+		    "Usage: %s [-p] file.bof\n        %s [-t] file.bof\n"
+		    "        %s -d N file.bof\n"
+		    "        %s [-e switch|ir] [-P] [-m] file.bof\n"
+		    "        %s -g file.bof\n"
+		    "        %s [-w ADDR]... [-c FILE] file.bof\n"
+		    "        %s -b file.bof input...\n"
+		    "        %s [-e switch|ir] [-t | -d N] -C DIR file.bof\n"
+		    "        %s -s SOCKET [-j N] file.bof\n"
+		    "        %s [-e switch|ir] [-t] --fork-server SOCKET file.bof\n"
+		    "        %s --fork-client SOCKET",
+		    cmdname, cmdname, cmdname, cmdname, cmdname, cmdname,
+		    cmdname, cmdname, cmdname, cmdname, cmdname);
+}
+
+// the file that the coverage is merged into (with -c)
+static const char *coverage_file = NULL;
+
+// Merge the coverage collected into coverage_file
+// (when the program exits, even with an error)
+static void save_coverage()
+{
+    coverage_merge_into(coverage_file);
 }
 
 // Run the VM on the .bof file name given in argv[1]
@@ -21,20 +52,125 @@ int main(int argc, char *argv[])
     argc--;
     argv++;
 
+    if (argc == 2 && strcmp(argv[0], "--fork-client") == 0) {
+	// have a fork server run its program with this stdin and stdout
+	return fork_server_client(argv[1]);
+    }
+
     bool print_program = false;
     bool trace_execution = false;
-    if (argc == 2 && strcmp(argv[0], "-p") == 0) {
-	print_program = true;
-	argc--;
-	argv++;
-    } else if (argc == 2 && strcmp(argv[0], "-t") == 0) {
-	trace_execution = true;
-	argc--;
-	argv++;
+    // the interval given with -d (0 if there is none)
+    int trace_interval = 0;
+    bool count_perf = false;
+    bool profile_memory = false;
+    bool debug = false;
+    bool batch = false;
+    // the directory of the run cache (with -C)
+    const char *cache_dir = NULL;
+    // the socket that sessions connect to (with -s)
+    const char *session_socket = NULL;
+    // the number of threads that run the sessions (with -j)
+    int num_workers = 1;
+    // the socket of the fork server (with --fork-server)
+    const char *fork_server_socket = NULL;
+    // the addresses given with -w (which are watched once GP is known)
+    const char *watches[MAX_WATCHES];
+    int num_watches = 0;
+    while (argc >= 2 && argv[0][0] == '-') {
+	if (strcmp(argv[0], "-p") == 0) {
+	    print_program = true;
+	    argc--;
+	    argv++;
+	} else if (strcmp(argv[0], "-t") == 0) {
+	    trace_execution = true;
+	    argc--;
+	    argv++;
+	} else if (argc >= 3 && strcmp(argv[0], "-d") == 0) {
+	    // trace only the changes, with the full state every N steps
+	    trace_interval = atoi(argv[1]);
+	    if (trace_interval <= 0) {
+		usage(cmdname);
+	    }
+	    machine_set_trace_diff(trace_interval);
+	    trace_execution = true;
+	    argc -= 2;
+	    argv += 2;
+	} else if (argc >= 3 && strcmp(argv[0], "-e") == 0) {
+	    // choose the execution engine
+	    if (strcmp(argv[1], "ir") == 0) {
+		machine_set_engine(ir_engine);
+	    } else if (strcmp(argv[1], "switch") == 0) {
+		machine_set_engine(switch_engine);
+	    } else {
+		usage(cmdname);
+	    }
+	    argc -= 2;
+	    argv += 2;
+	} else if (strcmp(argv[0], "-P") == 0) {
+	    // report the host's performance counters for the run
+	    count_perf = true;
+	    argc--;
+	    argv++;
+	} else if (argc >= 3 && strcmp(argv[0], "-w") == 0) {
+	    // watch writes to a word (ADDR or gp+N)
+	    if (num_watches == MAX_WATCHES) {
+		bail_with_error("At most %d watchpoints can be given!",
+				MAX_WATCHES);
+	    }
+	    watches[num_watches++] = argv[1];
+	    argc -= 2;
+	    argv += 2;
+	} else if (argc >= 3 && strcmp(argv[0], "-c") == 0) {
+	    // collect edge coverage, merging it into a file
+	    coverage_file = argv[1];
+	    argc -= 2;
+	    argv += 2;
+	} else if (strcmp(argv[0], "-g") == 0) {
+	    // run the program in the debugger
+	    debug = true;
+	    argc--;
+	    argv++;
+	} else if (argc >= 3 && strcmp(argv[0], "-C") == 0) {
+	    // answer runs from (and record them in) a cache
+	    cache_dir = argv[1];
+	    argc -= 2;
+	    argv += 2;
+	} else if (argc >= 3 && strcmp(argv[0], "-s") == 0) {
+	    // serve sessions of the program on a Unix-domain socket
+	    session_socket = argv[1];
+	    argc -= 2;
+	    argv += 2;
+	} else if (argc >= 3 && strcmp(argv[0], "--fork-server") == 0) {
+	    // load the program once, and fork a copy of the VM for each run
+	    fork_server_socket = argv[1];
+	    argc -= 2;
+	    argv += 2;
+	} else if (argc >= 3 && strcmp(argv[0], "-j") == 0) {
+	    num_workers = atoi(argv[1]);
+	    if (num_workers <= 0) {
+		usage(cmdname);
+	    }
+	    argc -= 2;
+	    argv += 2;
+	} else if (strcmp(argv[0], "-b") == 0) {
+	    // run the program on each input file, several at once
+	    batch = true;
+	    argc--;
+	    argv++;
+	} else if (strcmp(argv[0], "-m") == 0) {
+	    // profile the program's memory accesses
+	    machine_set_profiling(true);
+	    profile_memory = true;
+	    argc--;
+	    argv++;
+	} else {
+	    usage(cmdname);
+	}
     }
 
     // now there should be exactly 1 file argument
-    if (argc != 1 || argv[0][0] == '-') {
+    // (followed by the input files, with -b)
+    if ((batch ? argc < 2 : argc != 1) || argv[0][0] == '-') {
 	usage(cmdname);
     }
 
@@ -43,20 +179,87 @@ int main(int argc, char *argv[])
 	usage(cmdname);
     }
 
+    // the effects of these options are not recorded in the cache
+    if (cache_dir != NULL
+	&& (count_perf || profile_memory || num_watches > 0
+	    || coverage_file != NULL)) {
+	bail_with_error("The -C option cannot be used with -P, -m, -w, or -c!");
+    }
+
+    // a run found in the cache is not done again
+    // (the options that change the output are part of its key)
+    int cached_exit_code;
+    char cache_options[64];
+    sprintf(cache_options, "-e %s -t %d -d %d",
+	    machine_engine_name(), trace_execution, trace_interval);
+    if (cache_dir != NULL && !print_program && !debug && !batch
+	&& run_cache_lookup(cache_dir, argv[0], cache_options,
+			    &cached_exit_code)) {
+	return cached_exit_code;
+    }
+
     BOFFILE bf = bof_read_open(argv[0]);
 
     machine_load(bf);
 
+    for (int i = 0; i < num_watches; i++) {
+	unsigned int wa;
+	if (sscanf(watches[i], "gp+%u", &wa) == 1) {
+	    wa += machine_global_base();
+	} else if (sscanf(watches[i], "%u", &wa) != 1) {
+	    usage(cmdname);
+	}
+	if (wa >= MEMORY_SIZE_IN_WORDS) {
+	    bail_with_error("Watched address (%u) is not in the VM's memory!",
+			    wa);
+	}
+	watchpoints_add(wa);
+    }
+
     // if printing, don't run the program
     if (print_program) {
 	machine_print_loaded_program(stdout);
 	return EXIT_SUCCESS;
     }
     
-    machine_run(trace_execution);
+    if (fork_server_socket != NULL) {
+	fork_server_serve(fork_server_socket, trace_execution);
+    }
 
-    // the following should never execute,
-    // as the exit system call will call exit(0),
-    // and if the machine goes into an infinite loop it never gets here!
-    return EXIT_SUCCESS;
+    if (session_socket != NULL) {
+	green_threads_serve(session_socket, num_workers);
+    }
+
+    if (batch) {
+	int failures = lockstep_run_all(stderr, argc - 1, argv + 1);
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (debug) {
+	return debugger_run();
+    }
+
+    if (coverage_file != NULL) {
+	coverage_start();
+	atexit(save_coverage);
+    }
+
+    if (count_perf) {
+	perf_counters_start();
+    }
+
+    // the exit code is the one given by the program's EXIT instruction
+    int exit_code = machine_run(trace_execution);
+
+    if (cache_dir != NULL) {
+	run_cache_store(exit_code);
+    }
+
+    if (count_perf) {
+	perf_counters_stop_and_report(stderr, machine_engine_name());
+    }
+    if (profile_memory) {
+	machine_print_profile(stderr);
+    }
+    return exit_code;
 }
@@ -0,0 +1,105 @@
+// The state of the VM, shared by the modules that implement it
+// (machine.c and its execution engines).
+// Other code should only use the interface in machine.h.
+#ifndef _MACHINE_STATE_H
+#define _MACHINE_STATE_H
+#include <stdbool.h>
+#include "machine_types.h"
+#include "machine.h"
+#include "regname.h"
+#include "utilities.h"
+
+// the VM's memory, in signed and unsigned word and binary instruction views.
+union mem_u {
+    word_type words[MEMORY_SIZE_IN_WORDS];
+    uword_type uwords[MEMORY_SIZE_IN_WORDS];
+    bin_instr_t instrs[MEMORY_SIZE_IN_WORDS];
+};
+extern union mem_u memory;
+
+// general purpose registers
+extern word_type GPR[NUM_REGISTERS];
+
+// hi and lo registers used in multiplication and division.
+// A view as a (signed) long int (result, 64 bits)
+// and as an array (hilo) of 2 32-bit ints.
+union longAs2words_u {
+    long result;
+    word_type hilo[2]; 
+};
+extern union longAs2words_u hilo_regs;
+
+// LO is index 0, HI is index 1, for an x86 architecture
+// (because the x86 is little-endian)
+#define LO 0
+#define HI 1
+
+// the program counter
+extern address_type PC;
+
+// should the machine be printing tracing output?
+extern bool tracing;
+
+// should the machine be running?
+// (volatile, as a watchpoint's fault handler can stop the machine)
+extern volatile bool running;
+
+// the exit code given by the program's EXIT instruction
+extern int exit_code;
+
+// words of instructions (based on the header)
+extern unsigned short instruction_words;
+
+// The memory is tracked in pages of DIRTY_PAGE_WORDS words,
+// so that resetting the machine only zeros the pages that were written.
+#define DIRTY_PAGE_SHIFT 8
+#define DIRTY_PAGE_WORDS (1 << DIRTY_PAGE_SHIFT)
+#define NUM_DIRTY_PAGES (MEMORY_SIZE_IN_WORDS >> DIRTY_PAGE_SHIFT)
+
+// dirty_pages[p] is true when page p has been written since the last reset
+extern bool dirty_pages[NUM_DIRTY_PAGES];
+// the page numbers of the dirty pages, in the order they were first written
+extern unsigned short dirty_page_list[NUM_DIRTY_PAGES];
+extern unsigned int num_dirty_pages;
+
+// each instruction writes at most one word of memory;
+// last_written is the word address written by the last instruction,
+// (NO_WORD_WRITTEN if it did not write memory)
+// and last_written_old is the value that word had before the write
+#define NO_WORD_WRITTEN MEMORY_SIZE_IN_WORDS
+extern address_type last_written;
+extern word_type last_written_old;
+// should mem_written record last_written and last_written_old?
+// (only the incremental trace, the memory profile and the IR engine
+// use them, so other runs skip recording them)
+extern bool recording_writes;
+
+// Mark the page holding the word at word address wa as dirty
+// (reporting an error if wa is outside the memory)
+static inline void mem_mark_dirty(address_type wa)
+{
+    if (wa >= MEMORY_SIZE_IN_WORDS) {
+	bail_with_error("Attempt to write outside the memory (word address %u)!",
+			wa);
+    }
+    unsigned int page = wa >> DIRTY_PAGE_SHIFT;
+    if (!dirty_pages[page]) {
+	dirty_pages[page] = true;
+	dirty_page_list[num_dirty_pages++] = page;
+    }
+}
+
+// Record that the word at word address wa is about to be written
+// (see recording_writes) and return wa (so this can wrap the address in a store),
+// reporting an error if wa is outside the memory.
+static inline address_type mem_written(address_type wa)
+{
+    mem_mark_dirty(wa);
+    if (recording_writes) {
+	last_written = wa;
+	last_written_old = memory.words[wa];
+    }
+    return wa;
+}
+
+#endif
@@ -86,6 +86,22 @@ void machine_types_check_fits_in_addr(address_type addr)
     }
 }
 
+// Requires: divisor != 0
+// Set *quot and *rem to the quotient and remainder of dividend / divisor
+// (the most negative word divided by -1 overflows, which traps on the host,
+// so that quotient wraps around to the dividend itself, with remainder 0)
+void machine_types_divide(word_type dividend, word_type divisor,
+			  word_type *quot, word_type *rem)
+{
+    if (divisor == -1) {
+	*quot = (word_type) (- (uword_type) dividend);
+	*rem = 0;
+	return;
+    }
+    *quot = dividend / divisor;
+    *rem = dividend % divisor;
+}
+
 // Return the nearest multiple of BYTES_PER_WORD
 // that is greater than or equal to n
 int machine_types_round_up_to_wordsize(unsigned int n)
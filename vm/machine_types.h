@@ -89,6 +89,13 @@ extern void machine_types_check_fits_in_uimmed(word_type arg);
 // bail with an error message if not (so doesn't return if wrong)
 extern void machine_types_check_fits_in_addr(address_type addr);
 
+// Requires: divisor != 0
+// Set *quot and *rem to the quotient and remainder of dividend / divisor
+// (the most negative word divided by -1 overflows, which traps on the host,
+// so that quotient wraps around to the dividend itself, with remainder 0)
+extern void machine_types_divide(word_type dividend, word_type divisor,
+				 word_type *quot, word_type *rem);
+
 // the following line is for the documentation
 // ...
 #endif
@@ -0,0 +1,209 @@
+// Guest memory-access heatmap and stack-depth profiler for the VM
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "machine.h"
+#include "mem_profile.h"
+#include "utilities.h"
+
+// stack accesses are grouped by their depth below the stack bottom
+// in buckets of this many words
+#define STACK_BUCKET_WORDS 16
+// number of the most fetched instructions to report
+#define HOTTEST_INSTRS 8
+// number of global words reported per line
+#define GLOBALS_PER_LINE 4
+
+// per-word access counts
+static unsigned int read_counts[MEMORY_SIZE_IN_WORDS];
+static unsigned int write_counts[MEMORY_SIZE_IN_WORDS];
+static unsigned int fetch_counts[MEMORY_SIZE_IN_WORDS];
+
+// the layout of the program being profiled
+static address_type text_length;
+static address_type globals_start;
+static address_type globals_end;   // one past the last global word
+static address_type stack_bottom;
+// the smallest value of SP seen
+static address_type lowest_sp;
+
+// Start a new profile for a program whose text is the words [0, text_words),
+// whose globals are the words [global_base, global_base+global_words),
+// and whose stack grows down from the word address stack_bottom.
+void mem_profile_start(address_type text_words,
+		       address_type global_base,
+		       address_type global_words,
+		       address_type stack_bot)
+{
+    memset(read_counts, 0, sizeof(read_counts));
+    memset(write_counts, 0, sizeof(write_counts));
+    memset(fetch_counts, 0, sizeof(fetch_counts));
+    text_length = text_words;
+    globals_start = global_base;
+    globals_end = global_base + global_words;
+    stack_bottom = stack_bot;
+    lowest_sp = stack_bot;
+}
+
+// Record that the instruction at word address wa was fetched
+void mem_profile_fetch(address_type wa)
+{
+    if (wa < MEMORY_SIZE_IN_WORDS) {
+	fetch_counts[wa]++;
+    }
+}
+
+// Record a read of the memory word at word address wa
+void mem_profile_read(address_type wa)
+{
+    if (wa < MEMORY_SIZE_IN_WORDS) {
+	read_counts[wa]++;
+    }
+}
+
+// Record a write of the memory word at word address wa
+void mem_profile_write(address_type wa)
+{
+    if (wa < MEMORY_SIZE_IN_WORDS) {
+	write_counts[wa]++;
+    }
+}
+
+// Record the value of the SP register (after an instruction executes),
+// to find the high-water mark of the stack
+void mem_profile_stack_pointer(address_type sp)
+{
+    if (sp < lowest_sp) {
+	lowest_sp = sp;
+    }
+}
+
+// Is wa in the stack (between the end of the globals and the stack bottom)?
+static bool in_stack(address_type wa)
+{
+    return globals_end <= wa && wa <= stack_bottom;
+}
+
+// Return the sum of the counts in the range [start, end)
+static unsigned long sum_counts(const unsigned int counts[],
+				address_type start, address_type end)
+{
+    unsigned long ret = 0;
+    for (address_type wa = start; wa < end && wa < MEMORY_SIZE_IN_WORDS;
+	 wa++) {
+	ret += counts[wa];
+    }
+    return ret;
+}
+
+// Print the number of fetches of the text and its most fetched instructions
+static void print_text_profile(FILE *out)
+{
+    fprintf(out, "%-8s [%u, %u): %lu fetches; hottest:", "text",
+	    0, text_length, sum_counts(fetch_counts, 0, text_length));
+    address_type hottest[HOTTEST_INSTRS];
+    int num_hot = 0;
+    while (num_hot < HOTTEST_INSTRS) {
+	// find the most fetched instruction not yet reported
+	bool found = false;
+	address_type best = 0;
+	for (address_type wa = 0; wa < text_length; wa++) {
+	    bool already = false;
+	    for (int i = 0; i < num_hot; i++) {
+		already = already || hottest[i] == wa;
+	    }
+	    if (!already && fetch_counts[wa] > 0
+		&& (!found || fetch_counts[wa] > fetch_counts[best])) {
+		best = wa;
+		found = true;
+	    }
+	}
+	if (!found) {
+	    break;
+	}
+	hottest[num_hot++] = best;
+	fprintf(out, " %u: %u", best, fetch_counts[best]);
+    }
+    newline(out);
+}
+
+// Print the reads and writes of each global word that was accessed
+static void print_globals_profile(FILE *out)
+{
+    fprintf(out, "%-8s [%u, %u): %lu reads, %lu writes\n", "globals",
+	    globals_start, globals_end,
+	    sum_counts(read_counts, globals_start, globals_end),
+	    sum_counts(write_counts, globals_start, globals_end));
+    int on_line = 0;
+    for (address_type wa = globals_start; wa < globals_end; wa++) {
+	if (read_counts[wa] == 0 && write_counts[wa] == 0) {
+	    continue;
+	}
+	fprintf(out, "%8u: %ur %uw", wa, read_counts[wa], write_counts[wa]);
+	if (++on_line == GLOBALS_PER_LINE) {
+	    newline(out);
+	    on_line = 0;
+	}
+    }
+    if (on_line != 0) {
+	newline(out);
+    }
+}
+
+// Print the stack's high-water mark and its accesses grouped by depth
+static void print_stack_profile(FILE *out)
+{
+    fprintf(out, "%-8s [%u, %u]: %lu reads, %lu writes\n", "stack",
+	    globals_end, stack_bottom,
+	    sum_counts(read_counts, globals_end, stack_bottom + 1),
+	    sum_counts(write_counts, globals_end, stack_bottom + 1));
+    // programs may also use words below SP, so the high-water mark
+    // is the lowest of SP and the lowest stack word accessed
+    address_type lowest_used = lowest_sp;
+    for (address_type wa = globals_end; wa < lowest_used; wa++) {
+	if (read_counts[wa] != 0 || write_counts[wa] != 0) {
+	    lowest_used = wa;
+	}
+    }
+    fprintf(out, "    high-water mark: %u words below the stack bottom"
+	    " (lowest SP: %u)\n", stack_bottom - lowest_used, lowest_sp);
+    for (address_type depth = 0; depth <= stack_bottom - globals_end;
+	 depth += STACK_BUCKET_WORDS) {
+	address_type high = stack_bottom - depth;
+	address_type low = (high + 1 - globals_end < STACK_BUCKET_WORDS)
+	    ? globals_end : high + 1 - STACK_BUCKET_WORDS;
+	unsigned long r = sum_counts(read_counts, low, high + 1);
+	unsigned long w = sum_counts(write_counts, low, high + 1);
+	if (r != 0 || w != 0) {
+	    fprintf(out, "    depth %5u-%-5u: %lu reads, %lu writes\n",
+		    depth, depth + (high - low), r, w);
+	}
+    }
+}
+
+// Print the accesses outside the text, globals and stack
+static void print_other_profile(FILE *out)
+{
+    unsigned long r = 0;
+    unsigned long w = 0;
+    for (address_type wa = 0; wa < MEMORY_SIZE_IN_WORDS; wa++) {
+	bool in_globals = globals_start <= wa && wa < globals_end;
+	if (!in_globals && !in_stack(wa)) {
+	    r += read_counts[wa];
+	    w += write_counts[wa];
+	}
+    }
+    fprintf(out, "%-8s: %lu reads, %lu writes\n", "other", r, w);
+}
+
+// Print the profile (a compact histogram of accesses grouped into
+// text, globals, stack and other memory, and the stack's high-water mark)
+// to out
+void mem_profile_print(FILE *out)
+{
+    fprintf(out, "Memory access profile\n");
+    print_text_profile(out);
+    print_globals_profile(out);
+    print_stack_profile(out);
+    print_other_profile(out);
+}
@@ -0,0 +1,33 @@
+// Guest memory-access heatmap and stack-depth profiler for the VM
+#ifndef _MEM_PROFILE_H
+#define _MEM_PROFILE_H
+#include <stdio.h>
+#include "machine_types.h"
+
+// Start a new profile for a program whose text is the words [0, text_words),
+// whose globals are the words [global_base, global_base+global_words),
+// and whose stack grows down from the word address stack_bottom.
+extern void mem_profile_start(address_type text_words,
+			      address_type global_base,
+			      address_type global_words,
+			      address_type stack_bottom);
+
+// Record that the instruction at word address wa was fetched
+extern void mem_profile_fetch(address_type wa);
+
+// Record a read of the memory word at word address wa
+extern void mem_profile_read(address_type wa);
+
+// Record a write of the memory word at word address wa
+extern void mem_profile_write(address_type wa);
+
+// Record the value of the SP register (after an instruction executes),
+// to find the high-water mark of the stack
+extern void mem_profile_stack_pointer(address_type sp);
+
+// Print the profile (a compact histogram of accesses grouped into
+// text, globals, stack and other memory, and the stack's high-water mark)
+// to out
+extern void mem_profile_print(FILE *out);
+
+#endif
@@ -0,0 +1,148 @@
+// Host hardware performance counters for measuring the VM,
+// using the Linux perf_event_open system call
+// (syscall is only declared when _GNU_SOURCE is defined)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// the counters measured, in the order they are reported
+typedef enum { cycles_ctr, instructions_ctr, branch_misses_ctr,
+	       l1d_misses_ctr, l1i_misses_ctr, NUM_COUNTERS } counter_kind;
+
+static const char *counter_names[NUM_COUNTERS] = {
+    "cycles", "instructions", "branch-misses",
+    "L1-dcache-load-misses", "L1-icache-load-misses"
+};
+
+// file descriptors of the open counters (-1 if not available)
+static int counter_fds[NUM_COUNTERS];
+
+// Return the (type, config) of the perf event for counter k
+static void counter_event(counter_kind k, unsigned int *type,
+			  unsigned long long *config)
+{
+    static const unsigned long long cache_read_miss
+	= (PERF_COUNT_HW_CACHE_OP_READ << 8)
+	| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    switch (k) {
+    case cycles_ctr:
+	*type = PERF_TYPE_HARDWARE;
+	*config = PERF_COUNT_HW_CPU_CYCLES;
+	break;
+    case instructions_ctr:
+	*type = PERF_TYPE_HARDWARE;
+	*config = PERF_COUNT_HW_INSTRUCTIONS;
+	break;
+    case branch_misses_ctr:
+	*type = PERF_TYPE_HARDWARE;
+	*config = PERF_COUNT_HW_BRANCH_MISSES;
+	break;
+    case l1d_misses_ctr:
+	*type = PERF_TYPE_HW_CACHE;
+	*config = PERF_COUNT_HW_CACHE_L1D | cache_read_miss;
+	break;
+    case l1i_misses_ctr:
+	*type = PERF_TYPE_HW_CACHE;
+	*config = PERF_COUNT_HW_CACHE_L1I | cache_read_miss;
+	break;
+    default:
+	*type = PERF_TYPE_HARDWARE;
+	*config = PERF_COUNT_HW_CPU_CYCLES;
+	break;
+    }
+}
+
+// Open (disabled) the counter for kind k, returning its fd or -1
+static int open_counter(counter_kind k)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    counter_event(k, &attr.type, &attr.config);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Start counting host cycles, instructions, branch mispredictions
+// and L1 cache misses for this process (in user mode only).
+// Returns true if at least one counter could be started.
+bool perf_counters_start()
+{
+    bool any = false;
+    for (int k = 0; k < NUM_COUNTERS; k++) {
+	counter_fds[k] = open_counter(k);
+	any = any || counter_fds[k] >= 0;
+    }
+    // enable them all together, as late as possible
+    for (int k = 0; k < NUM_COUNTERS; k++) {
+	if (counter_fds[k] >= 0) {
+	    ioctl(counter_fds[k], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(counter_fds[k], PERF_EVENT_IOC_ENABLE, 0);
+	}
+    }
+    return any;
+}
+
+// Stop counting and print a report of the counters to out,
+// labeled with the name of the dispatch engine that was measured.
+void perf_counters_stop_and_report(FILE *out, const char *engine)
+{
+    long long counts[NUM_COUNTERS];
+    bool have[NUM_COUNTERS];
+    for (int k = 0; k < NUM_COUNTERS; k++) {
+	if (counter_fds[k] >= 0) {
+	    ioctl(counter_fds[k], PERF_EVENT_IOC_DISABLE, 0);
+	}
+    }
+    for (int k = 0; k < NUM_COUNTERS; k++) {
+	have[k] = counter_fds[k] >= 0
+	    && read(counter_fds[k], &counts[k], sizeof(counts[k]))
+	       == sizeof(counts[k]);
+	if (counter_fds[k] >= 0) {
+	    close(counter_fds[k]);
+	    counter_fds[k] = -1;
+	}
+    }
+
+    fprintf(out, "Host performance counters (engine: %s)\n", engine);
+    for (int k = 0; k < NUM_COUNTERS; k++) {
+	if (have[k]) {
+	    fprintf(out, "%24s: %lld\n", counter_names[k], counts[k]);
+	} else {
+	    fprintf(out, "%24s: not available\n", counter_names[k]);
+	}
+    }
+    if (have[cycles_ctr] && have[instructions_ctr] && counts[cycles_ctr] > 0) {
+	fprintf(out, "%24s: %.2f\n", "IPC",
+		(double) counts[instructions_ctr] / counts[cycles_ctr]);
+    }
+    fflush(out);
+}
+
+#else  // not __linux__, so there are no counters to read
+
+// Counters are only available on Linux, so this always returns false
+bool perf_counters_start()
+{
+    return false;
+}
+
+// Print a report saying that counters are not available to out
+void perf_counters_stop_and_report(FILE *out, const char *engine)
+{
+    fprintf(out, "Host performance counters (engine: %s): not available\n",
+	    engine);
+    fflush(out);
+}
+
+#endif
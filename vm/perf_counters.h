@@ -0,0 +1,18 @@
+// Host hardware performance counters for measuring the VM
+#ifndef _PERF_COUNTERS_H
+#define _PERF_COUNTERS_H
+#include <stdio.h>
+#include <stdbool.h>
+
+// Start counting host cycles, instructions, branch mispredictions
+// and L1 cache misses for this process (in user mode only).
+// Returns true if at least one counter could be started;
+// counters that the host (or its permissions) do not support
+// are reported as not available.
+extern bool perf_counters_start();
+
+// Stop counting and print a report of the counters to out,
+// labeled with the name of the dispatch engine that was measured.
+extern void perf_counters_stop_and_report(FILE *out, const char *engine);
+
+#endif
@@ -0,0 +1,307 @@
+// An on-disk cache of the results (output and exit code) of runs
+// of the VM, keyed by hashes of the program, of its standard input
+// and of the options that change its output.
+// Each entry is a file, named by the key, whose first line gives the
+// exit code, followed by the run's output.  Entries are written to a
+// temporary file and renamed into place, so several vm processes can
+// use the same cache; removing the least recently used entries
+// (by their modification times, which are updated on each hit)
+// is done while holding a lock on the cache's lock file.
+// (flock, fileno and mkstemp are only declared when _GNU_SOURCE is defined)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "run_cache.h"
+#include "utilities.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+// the first line of each entry, with the exit code
+#define ENTRY_HEADER_FORMAT "SSM run exit code %d\n"
+// the suffix of the names of the entries
+#define ENTRY_SUFFIX ".run"
+// the name of the lock file in the cache's directory
+#define LOCK_FILE_NAME ".lock"
+// size of the buffers used to read and copy files
+#define COPY_BUF_SIZE 8192
+
+// the cache's directory and the name of the current run's entry
+static const char *cache_dir;
+static char *entry_path;
+
+// the captured output of the current run, and the original stdout
+static FILE *captured;
+static int saved_stdout;
+// is stdout being captured?
+static bool capturing = false;
+
+// Return the 64-bit FNV-1a hash of the size bytes in data
+static unsigned long long fnv1a(const char *data, size_t size)
+{
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+	h ^= (unsigned char) data[i];
+	h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Read all of f into a new buffer, setting *size to the number of bytes
+static char *read_all(FILE *f, size_t *size)
+{
+    size_t capacity = COPY_BUF_SIZE;
+    char *ret = (char *) malloc(capacity);
+    *size = 0;
+    size_t n;
+    while (ret != NULL
+	   && (n = fread(ret + *size, 1, capacity - *size, f)) > 0) {
+	*size += n;
+	if (*size == capacity) {
+	    capacity *= 2;
+	    ret = (char *) realloc(ret, capacity);
+	}
+    }
+    if (ret == NULL) {
+	bail_with_error("Cannot allocate space for the run cache!");
+    }
+    return ret;
+}
+
+// Copy the rest of the file from to the file to
+static void copy_file(FILE *from, FILE *to)
+{
+    char buf[COPY_BUF_SIZE];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), from)) > 0) {
+	fwrite(buf, 1, n, to);
+    }
+}
+
+// Return a new string with the path of the file name in the cache
+static char *cache_path(const char *name)
+{
+    char *ret = (char *) malloc(strlen(cache_dir) + strlen(name) + 2);
+    if (ret == NULL) {
+	bail_with_error("Cannot allocate space for the run cache!");
+    }
+    sprintf(ret, "%s/%s", cache_dir, name);
+    return ret;
+}
+
+// Stop capturing stdout and copy what was captured to the real stdout
+// (if the output is being captured)
+static void finish_capture()
+{
+    if (!capturing) {
+	return;
+    }
+    capturing = false;
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    fseek(captured, 0, SEEK_SET);
+    copy_file(captured, stdout);
+    fflush(stdout);
+}
+
+// Look up the run of the program in the file named bofname,
+// with all of the standard input (which is read now)
+// and the VM options described by the string options
+// (which must give all the options that change the output),
+// in the cache in the directory dir (which is created if needed).
+// If the run is in the cache, its output is written on stdout,
+// *exit_code is set to its exit code, and true is returned.
+// Otherwise the standard input is set up to be read again
+// and stdout is captured (for run_cache_store), and false is returned.
+bool run_cache_lookup(const char *dir, const char *bofname,
+		      const char *options, int *exit_code)
+{
+    cache_dir = dir;
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+	bail_with_error("Cannot create the run cache directory %s", dir);
+    }
+
+    FILE *bof = fopen(bofname, "rb");
+    if (bof == NULL) {
+	bail_with_error("Error opening file for reading: %s", bofname);
+    }
+    size_t bof_size;
+    char *bof_data = read_all(bof, &bof_size);
+    fclose(bof);
+    size_t input_size;
+    char *input = read_all(stdin, &input_size);
+
+    // the entry's name is the key
+    char name[128];
+    sprintf(name, "%016llx-%zx-%016llx-%zx-%016llx" ENTRY_SUFFIX,
+	    fnv1a(bof_data, bof_size), bof_size,
+	    fnv1a(input, input_size), input_size,
+	    fnv1a(options, strlen(options)));
+    free(bof_data);
+    entry_path = cache_path(name);
+
+    FILE *entry = fopen(entry_path, "rb");
+    if (entry != NULL) {
+	char header[COPY_BUF_SIZE];
+	if (fgets(header, sizeof(header), entry) != NULL
+	    && sscanf(header, ENTRY_HEADER_FORMAT, exit_code) == 1) {
+	    copy_file(entry, stdout);
+	    fclose(entry);
+	    // mark the entry as recently used
+	    utime(entry_path, NULL);
+	    free(input);
+	    return true;
+	}
+	fclose(entry);
+    }
+
+    // replay the input from a temporary file
+    FILE *input_copy = tmpfile();
+    if (input_copy == NULL
+	|| fwrite(input, 1, input_size, input_copy) != input_size
+	|| fflush(input_copy) != 0
+	|| dup2(fileno(input_copy), STDIN_FILENO) < 0) {
+	bail_with_error("Cannot save the standard input for the run cache");
+    }
+    fclose(input_copy);
+    free(input);
+    clearerr(stdin);
+    fseek(stdin, 0, SEEK_SET);
+
+    // capture the output in another temporary file
+    fflush(stdout);
+    captured = tmpfile();
+    saved_stdout = dup(STDOUT_FILENO);
+    if (captured == NULL || saved_stdout < 0
+	|| dup2(fileno(captured), STDOUT_FILENO) < 0) {
+	bail_with_error("Cannot capture the output for the run cache");
+    }
+    capturing = true;
+    atexit(finish_capture);
+    // (so a later error message does not report the missing entry)
+    errno = 0;
+    return false;
+}
+
+// An entry in the cache's directory, when removing old entries
+typedef struct {
+    char *name;
+    off_t size;
+    time_t used;   // the last time it was used
+} cache_entry;
+
+// Compare cache entries by when they were last used
+static int compare_entries(const void *a, const void *b)
+{
+    time_t ta = ((const cache_entry *) a)->used;
+    time_t tb = ((const cache_entry *) b)->used;
+    return (ta > tb) - (ta < tb);
+}
+
+// Remove the least recently used entries from the cache
+// until its entries total at most RUN_CACHE_MAX_BYTES
+static void evict()
+{
+    char *lock_path = cache_path(LOCK_FILE_NAME);
+    int lock_fd = open(lock_path, O_RDWR | O_CREAT, 0666);
+    free(lock_path);
+    if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0) {
+	return;
+    }
+    DIR *d = opendir(cache_dir);
+    cache_entry *entries = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    long total = 0;
+    struct dirent *de;
+    while (d != NULL && (de = readdir(d)) != NULL) {
+	size_t len = strlen(de->d_name);
+	size_t suffix_len = strlen(ENTRY_SUFFIX);
+	if (len <= suffix_len
+	    || strcmp(de->d_name + len - suffix_len, ENTRY_SUFFIX) != 0) {
+	    continue;
+	}
+	char *path = cache_path(de->d_name);
+	struct stat st;
+	if (stat(path, &st) == 0) {
+	    if (count == capacity) {
+		capacity = 2 * capacity + 16;
+		entries = (cache_entry *) realloc(entries,
+						  capacity * sizeof(cache_entry));
+		if (entries == NULL) {
+		    bail_with_error("Cannot allocate space for the run cache!");
+		}
+	    }
+	    entries[count].name = path;
+	    entries[count].size = st.st_size;
+	    entries[count].used = st.st_mtime;
+	    count++;
+	    total += st.st_size;
+	} else {
+	    free(path);
+	}
+    }
+    if (d != NULL) {
+	closedir(d);
+    }
+    qsort(entries, count, sizeof(cache_entry), compare_entries);
+    for (size_t i = 0; i < count; i++) {
+	if (total > RUN_CACHE_MAX_BYTES && unlink(entries[i].name) == 0) {
+	    total -= entries[i].size;
+	}
+	free(entries[i].name);
+    }
+    free(entries);
+    flock(lock_fd, LOCK_UN);
+    close(lock_fd);
+}
+
+// Requires: run_cache_lookup returned false.
+// Copy the output captured for the run to stdout, and record it
+// and exit_code in the cache (removing old entries as needed).
+// (If the program stops with an error before this is called,
+// its output is copied to stdout when the VM exits, but not recorded.)
+void run_cache_store(int exit_code)
+{
+    finish_capture();
+    char *temp_path = cache_path("tmp-XXXXXX");
+    int fd = mkstemp(temp_path);
+    FILE *entry = (fd < 0) ? NULL : fdopen(fd, "wb");
+    if (entry != NULL) {
+	fprintf(entry, ENTRY_HEADER_FORMAT, exit_code);
+	fseek(captured, 0, SEEK_SET);
+	copy_file(captured, entry);
+	// the entry only appears (under its name) once it is complete
+	if (fclose(entry) != 0 || rename(temp_path, entry_path) != 0) {
+	    unlink(temp_path);
+	}
+    }
+    free(temp_path);
+    fclose(captured);
+    evict();
+}
+
+#else  // no POSIX file system calls, so runs are not cached
+
+// Runs are never found in the cache
+bool run_cache_lookup(const char *dir, const char *bofname,
+		      const char *options, int *exit_code)
+{
+    return false;
+}
+
+// Runs are not recorded
+void run_cache_store(int exit_code)
+{
+}
+
+#endif
@@ -0,0 +1,32 @@
+// An on-disk cache of the results (output and exit code) of runs
+// of the VM, keyed by hashes of the program, of its standard input
+// and of the options that change its output
+// (which determine the result, as the VM is deterministic)
+#ifndef _RUN_CACHE_H
+#define _RUN_CACHE_H
+#include <stdbool.h>
+
+// the most bytes kept in one cache directory
+// (the least recently used entries are removed to stay under this)
+#define RUN_CACHE_MAX_BYTES (64L * 1024 * 1024)
+
+// Look up the run of the program in the file named bofname,
+// with all of the standard input (which is read now)
+// and the VM options described by the string options
+// (which must give all the options that change the output),
+// in the cache in the directory dir (which is created if needed).
+// If the run is in the cache, its output is written on stdout,
+// *exit_code is set to its exit code, and true is returned.
+// Otherwise the standard input is set up to be read again
+// and stdout is captured (for run_cache_store), and false is returned.
+extern bool run_cache_lookup(const char *dir, const char *bofname,
+			     const char *options, int *exit_code);
+
+// Requires: run_cache_lookup returned false.
+// Copy the output captured for the run to stdout, and record it
+// and exit_code in the cache (removing old entries as needed).
+// (If the program stops with an error before this is called,
+// its output is copied to stdout when the VM exits, but not recorded.)
+extern void run_cache_store(int exit_code);
+
+#endif
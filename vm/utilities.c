@@ -43,6 +43,18 @@ static void vdebug_print(const char *fmt, va_list args)
 
 static void vbail_with_error(const char* fmt, va_list args);
 
+// if not NULL, called with the message instead of printing it and exiting
+static void (*bail_handler)(const char *msg) = NULL;
+
+// Make bail_with_error and bail_with_prog_error call handler
+// with the error message, instead of printing it and exiting.
+// The handler must not return (it can longjmp, e.g., in a test harness);
+// a NULL handler restores the usual behavior.
+void set_bail_handler(void (*handler)(const char *msg))
+{
+    bail_handler = handler;
+}
+
 // Format a string error message and print it followed by a newline on stderr
 // using perror (for an OS error, if the errno is not 0)
 // then exit with a failure code, so a call to this does not return.
@@ -60,6 +72,9 @@ static void vbail_with_error(const char* fmt, va_list args)
     extern int errno;
     char buff[2048];
     vsprintf(buff, fmt, args);
+    if (bail_handler != NULL) {
+	bail_handler(buff);
+    }
     if (errno != 0) {
 	perror(buff);
     } else {
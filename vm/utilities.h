@@ -18,6 +18,12 @@ void debug_print(const char *fmt, ...);
 // then exit with a failure code, so a call to this does not return.
 extern void bail_with_error(const char *fmt, ...);
 
+// Make bail_with_error and bail_with_prog_error call handler
+// with the error message, instead of printing it and exiting.
+// The handler must not return (it can longjmp, e.g., in a test harness);
+// a NULL handler restores the usual behavior.
+extern void set_bail_handler(void (*handler)(const char *msg));
+
 // Print an error message on stderr
 // starting with the file name and line number from the floc argument
 // (prints: filename, a colon, " line ", the line number, and a space)
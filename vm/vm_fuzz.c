@@ -0,0 +1,70 @@
+// A fuzzing harness for the VM's loader and execution engine,
+// with the entry point used by libFuzzer.
+// Each input is loaded from memory (with fmemopen), run with an
+// instruction budget, and the errors the VM reports (with
+// bail_with_error) jump back here instead of exiting,
+// so one process can run many inputs; loading the next input
+// resets the machine (only zeroing the memory that was written).
+// (fmemopen is only declared when _GNU_SOURCE is defined)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include "bof.h"
+#include "machine.h"
+#include "vm_fuzz.h"
+#include "utilities.h"
+
+// where errors reported by the VM go
+static jmp_buf on_error;
+
+// has the harness been set up?
+static bool initialized = false;
+
+// Return to LLVMFuzzerTestOneInput after the VM reports an error
+static void recover(const char *msg)
+{
+    longjmp(on_error, 1);
+}
+
+// Set up the harness: the guest's output is discarded,
+// it reads no input, and errors end only the current run
+static void initialize()
+{
+    if (freopen("/dev/null", "w", stdout) == NULL
+	|| freopen("/dev/null", "r", stdin) == NULL) {
+	bail_with_error("Cannot redirect the guest's standard I/O");
+    }
+    set_bail_handler(recover);
+    initialized = true;
+}
+
+// The entry point called by libFuzzer (or vm_fuzz_main.c) for each input:
+// load data (of size bytes) as a binary object file and run it
+// for at most VM_FUZZ_INSTRUCTION_BUDGET instructions.
+// Errors reported by the VM end the run, but not the process.
+// Always returns 0.
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    // (static, so it is still valid after a longjmp)
+    static FILE *input;
+    if (!initialized) {
+	initialize();
+    }
+    if (size == 0) {
+	return 0;
+    }
+    input = fmemopen((void *) data, size, "rb");
+    if (input == NULL) {
+	return 0;
+    }
+    if (setjmp(on_error) == 0) {
+	BOFFILE bf;
+	bf.fileptr = input;
+	bf.filename = "fuzz input";
+	machine_load(bf);
+	machine_run_bounded(VM_FUZZ_INSTRUCTION_BUDGET);
+    }
+    fclose(input);
+    return 0;
+}
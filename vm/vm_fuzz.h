@@ -0,0 +1,17 @@
+// A fuzzing harness for the VM's loader and execution engine
+#ifndef _VM_FUZZ_H
+#define _VM_FUZZ_H
+#include <stdint.h>
+#include <stddef.h>
+
+// the most instructions executed for one input
+#define VM_FUZZ_INSTRUCTION_BUDGET 10000
+
+// The entry point called by libFuzzer (or vm_fuzz_main.c) for each input:
+// load data (of size bytes) as a binary object file and run it
+// for at most VM_FUZZ_INSTRUCTION_BUDGET instructions.
+// Errors reported by the VM end the run, but not the process.
+// Always returns 0.
+extern int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#endif
@@ -0,0 +1,68 @@
+// A standalone driver for the VM's fuzzing harness (for compilers
+// without libFuzzer): it runs each file given as an input,
+// repeating each one N times (with -n N), and reports the throughput.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vm_fuzz.h"
+#include "utilities.h"
+
+static char *progname;
+
+void usage() {
+    bail_with_error("Usage: %s [-n N] file...", progname);
+}
+
+// Read the file named filename into a new buffer,
+// setting *size to the number of bytes read
+static uint8_t *read_file(const char *filename, size_t *size)
+{
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+	bail_with_error("Cannot open %s", filename);
+    }
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *ret = (uint8_t *) malloc(length > 0 ? length : 1);
+    if (ret == NULL) {
+	bail_with_error("Cannot allocate space to read %s", filename);
+    }
+    *size = fread(ret, 1, length, f);
+    fclose(f);
+    return ret;
+}
+
+// Run the harness on each file named in argv
+int main(int argc, char *argv[]) {
+    progname = argv[0];
+    argc--;
+    argv++;
+
+    long repeats = 1;
+    if (argc >= 2 && strcmp(argv[0], "-n") == 0) {
+	repeats = atol(argv[1]);
+	argc -= 2;
+	argv += 2;
+    }
+    if (argc < 1 || repeats <= 0) {
+	usage();
+    }
+
+    long runs = 0;
+    clock_t start = clock();
+    for (int i = 0; i < argc; i++) {
+	size_t size;
+	uint8_t *data = read_file(argv[i], &size);
+	for (long r = 0; r < repeats; r++) {
+	    LLVMFuzzerTestOneInput(data, size);
+	    runs++;
+	}
+	free(data);
+    }
+    double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    fprintf(stderr, "%ld runs in %.2f seconds (%.0f runs/second)\n",
+	    runs, seconds, seconds > 0 ? runs / seconds : 0.0);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,181 @@
+// Watchpoints on writes to the VM's memory, using host page protection.
+// The host pages backing watched words are made read-only, so writes to
+// them fault; the fault handler makes the page writable (so the write
+// completes when the handler returns), remembers the word's old value
+// and sets watchpoints_fault_pending, which makes the run loop stop
+// after the instruction.  Then watchpoints_resume reports the write,
+// protects the page again, and lets the machine go on.
+// (mprotect and sigaction are only declared when _GNU_SOURCE is defined)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <signal.h>
+#include "machine.h"
+#include "machine_state.h"
+#include "watchpoints.h"
+#include "utilities.h"
+
+// is there a write to a watched page that has not been reported yet?
+volatile sig_atomic_t watchpoints_fault_pending = false;
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+
+// the most host pages the memory can span (with pages of at least 1K)
+#define MAX_HOST_PAGES (sizeof(memory) / 1024)
+
+// the host's page size (0 until the first watchpoint is added)
+static size_t page_size = 0;
+
+// watched[wa] is true when the word at wa is watched
+static bool watched[MEMORY_SIZE_IN_WORDS];
+// protected_pages[p] is true when the host page p of the memory
+// is read-only (because it holds a watched word)
+static bool protected_pages[MAX_HOST_PAGES];
+static bool any_watched = false;
+
+// information about the last write to a protected page
+static volatile size_t fault_page;
+static volatile address_type fault_word;
+static volatile word_type fault_old_value;
+
+// Set the protection of the host page p of the memory
+static void protect_page(size_t p, int prot)
+{
+    if (mprotect((char *) memory.words + p * page_size, page_size, prot) != 0) {
+	bail_with_error("Cannot change the protection of the VM's memory");
+    }
+}
+
+// Handle a fault, which is a write to a watched page
+// if it is on a protected page of the memory
+// (this only records the fault, and makes the page writable so that
+// the write completes; it must not call protect_page, which can bail)
+static void on_fault(int sig, siginfo_t *info, void *context)
+{
+    char *base = (char *) memory.words;
+    char *addr = (char *) info->si_addr;
+    size_t p = (addr - base) / page_size;
+    if (addr < base || addr >= base + sizeof(memory) || !protected_pages[p]
+	|| mprotect(base + p * page_size, page_size,
+		    PROT_READ | PROT_WRITE) != 0) {
+	// not ours (or it cannot be let through), so let the fault
+	// happen again without this handler
+	signal(sig, SIG_DFL);
+	return;
+    }
+    fault_page = p;
+    fault_word = (addr - base) / sizeof(word_type);
+    fault_old_value = memory.words[fault_word];
+    watchpoints_fault_pending = true;
+}
+
+// Install the fault handler and find the page size
+static void start_watching()
+{
+    page_size = sysconf(_SC_PAGESIZE);
+    if (WATCHPOINT_PAGE_ALIGNMENT % page_size != 0
+	|| sizeof(memory) / page_size > MAX_HOST_PAGES) {
+	bail_with_error("The host's page size (%zu) is not supported"
+			" for watchpoints", page_size);
+    }
+    struct sigaction sa;
+    sa.sa_sigaction = on_fault;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_SIGINFO;
+    sigaction(SIGSEGV, &sa, NULL);
+    // some systems report writes to read-only pages with SIGBUS
+    sigaction(SIGBUS, &sa, NULL);
+}
+
+// Requires: wa < MEMORY_SIZE_IN_WORDS
+// Watch writes to the memory word at word address wa.
+// The host page holding it is made read-only, so only writes
+// to that page are slowed down.
+void watchpoints_add(address_type wa)
+{
+    if (page_size == 0) {
+	start_watching();
+    }
+    watched[wa] = true;
+    any_watched = true;
+    size_t p = wa * sizeof(word_type) / page_size;
+    if (!protected_pages[p]) {
+	protected_pages[p] = true;
+	protect_page(p, PROT_READ);
+    }
+}
+
+// Remove all watchpoints (making the memory writable again)
+void watchpoints_clear()
+{
+    if (!any_watched) {
+	return;
+    }
+    for (size_t p = 0; p < sizeof(memory) / page_size; p++) {
+	if (protected_pages[p]) {
+	    protected_pages[p] = false;
+	    protect_page(p, PROT_READ | PROT_WRITE);
+	}
+    }
+    for (address_type wa = 0; wa < MEMORY_SIZE_IN_WORDS; wa++) {
+	watched[wa] = false;
+    }
+    any_watched = false;
+    watchpoints_fault_pending = false;
+}
+
+// Are there any watchpoints?
+bool watchpoints_active()
+{
+    return any_watched;
+}
+
+// Requires: the instruction at addr was just executed
+// If that instruction wrote to a watched page,
+// report the write on out (if it was to a watched word),
+// protect the page again, and return true.
+// Otherwise return false.
+bool watchpoints_resume(FILE *out, address_type addr)
+{
+    if (!watchpoints_fault_pending) {
+	return false;
+    }
+    watchpoints_fault_pending = false;
+    if (watched[fault_word]) {
+	fflush(stdout);
+	fprintf(out, "Watchpoint: PC %u wrote %u: %d -> %d\n", addr,
+		fault_word, fault_old_value, memory.words[fault_word]);
+	fflush(out);
+    }
+    protect_page(fault_page, PROT_READ);
+    return true;
+}
+
+#else  // no page protection, so there are no watchpoints
+
+// Watchpoints are not available without page protection
+void watchpoints_add(address_type wa)
+{
+    bail_with_error("Watchpoints are not supported on this system");
+}
+
+// There are no watchpoints to remove
+void watchpoints_clear()
+{
+}
+
+// There are never any watchpoints
+bool watchpoints_active()
+{
+    return false;
+}
+
+// There are no watchpoints to report
+bool watchpoints_resume(FILE *out, address_type addr)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,36 @@
+// Watchpoints on writes to the VM's memory, using host page protection
+#ifndef _WATCHPOINTS_H
+#define _WATCHPOINTS_H
+#include <stdio.h>
+#include <stdbool.h>
+#include <signal.h>
+#include "machine_types.h"
+
+// the alignment of the VM's memory, which must be a multiple
+// of the host's page size for watchpoints to work
+#define WATCHPOINT_PAGE_ALIGNMENT 65536
+
+// Requires: wa < MEMORY_SIZE_IN_WORDS
+// Watch writes to the memory word at word address wa.
+// The host page holding it is made read-only, so only writes
+// to that page are slowed down.
+extern void watchpoints_add(address_type wa);
+
+// Remove all watchpoints (making the memory writable again)
+extern void watchpoints_clear();
+
+// Are there any watchpoints?
+extern bool watchpoints_active();
+
+// Set (by the fault handler) when an instruction writes to a watched page;
+// the machine stops after that instruction, and watchpoints_resume clears it
+extern volatile sig_atomic_t watchpoints_fault_pending;
+
+// Requires: the instruction at addr was just executed
+// If that instruction wrote to a watched page,
+// report the write on out (if it was to a watched word),
+// protect the page again, and return true.
+// Otherwise return false.
+extern bool watchpoints_resume(FILE *out, address_type addr);
+
+#endif